@@ -0,0 +1,539 @@
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/interrupt.h>  // tasklet API
+#include <linux/workqueue.h>  // work queue API
+#include <linux/kthread.h>    // Producers, kthread_worker
+#include <linux/irq_work.h>   // irq_work_queue
+#include <linux/completion.h> // Start barrier, run completion
+#include <linux/atomic.h>     // Outstanding items
+#include <linux/ktime.h>      // ktime_get_ns
+#include <linux/math64.h>     // div64_u64
+#include <linux/mm.h>         // kvcalloc
+#include <linux/slab.h>       // kcalloc
+#include <linux/mutex.h>      // Serialises benchmark runs
+#include <linux/debugfs.h>    // Benchmark control and results
+#include <linux/seq_file.h>   // results table
+#include <linux/string.h>     // memset
+#include <linux/version.h>    // LINUX_VERSION_CODE
+#include "defer_log.h"        // defer_dbg, verbose parameter
+#include "defer_stats.h"      // Latency percentiles
+#include "defer_run.h"        // debugfs "run" trigger
+#include "simplewq.h"         // SimpleWQ from ex3, if loaded
+
+DEFINE_DEFER_VERBOSE();
+
+// Deferred-work mechanism comparison.
+//
+// Drives one synthetic workload through every mechanism the exercises
+// use, plus kthread_worker and irq_work:
+//   tasklet, hi_tasklet - tasklet_schedule() / tasklet_hi_schedule() (ex1, ex2, ex6)
+//   simplewq            - ex3's kthread pools, only when ex3 is loaded
+//   system_wq           - queue_work() on system_wq (ex7)
+//   unbound_wq          - a WQ_UNBOUND queue of our own (ex8)
+//   delayed_work        - queue_delayed_work() with a one-jiffy delay (ex5);
+//                         its latency includes that tick by design
+//   kthread_worker      - a dedicated kthread_worker
+//   irq_work            - irq_work_queue(), handler in hard interrupt context
+//
+// For every mechanism and every producer count 1, 2, 4, ... up to
+// max_producers, that many kthreads are released together and each
+// submits bench_items items back to back. Every item's handler spins for
+// bench_work_ns. Per run we record:
+//   submit_ns  - average cost of one submit call, as seen by the producer
+//   p50/p90/p99/max_ns - dispatch latency, submit to handler start
+//   items_per_sec      - items / (last handler end - release of producers)
+//
+// Start with "echo run > /sys/kernel/debug/defer_bench/run" (returns when
+// the whole matrix is done) and read the comparison table from
+// /sys/kernel/debug/defer_bench/results.
+
+static unsigned int bench_items = 10000;
+module_param(bench_items, uint, 0644);
+MODULE_PARM_DESC(bench_items, "Items each producer submits per run");
+
+static unsigned int bench_work_ns;
+module_param(bench_work_ns, uint, 0644);
+MODULE_PARM_DESC(bench_work_ns, "Busy time per item (ns); also spent in hardirq for irq_work");
+
+static unsigned int max_producers = 4;
+module_param(max_producers, uint, 0644);
+MODULE_PARM_DESC(max_producers, "Largest number of producer threads (runs use 1, 2, 4, ... up to this)");
+
+#define BENCH_MAX_PRODUCERS 64
+#define BENCH_MAX_ITEMS     (1U << 20) // Per producer
+#define BENCH_TIMEOUT       (30 * HZ)  // Per run
+#define BENCH_MAX_RESULTS   64
+
+struct bench_item {
+    union {
+        struct tasklet_struct tasklet;
+        struct work_struct work;
+        struct delayed_work dwork;
+        struct kthread_work kwork;
+        struct irq_work iw;
+        simple_work_t swork;
+    };
+    u64 submit_ns;
+    u64 start_ns;
+};
+
+struct bench_mech {
+    const char *name;
+    int (*setup)(void);       // Optional; -ENODEV skips the mechanism
+    void (*teardown)(void);   // Optional
+    void (*init)(struct bench_item *item);
+    void (*submit)(struct bench_item *item);
+    void (*sync)(struct bench_item *item); // Item idle afterwards; optional
+};
+
+struct bench_producer {
+    struct task_struct *task;
+    const struct bench_mech *mech;
+    struct bench_item *items;
+    unsigned int nr;
+    u64 submit_ns;  // Summed over all submit calls
+};
+
+struct bench_result {
+    const char *mech;
+    unsigned int producers;
+    unsigned long items;
+    u64 submit_ns;
+    u64 p50_ns, p90_ns, p99_ns, max_ns;
+    u64 per_sec;
+};
+
+static DEFINE_MUTEX(bench_lock); // Protects everything below
+static struct bench_result bench_results[BENCH_MAX_RESULTS];
+static unsigned int bench_nr_results;
+static struct dentry *bench_debugfs_dir;
+
+static DECLARE_COMPLETION(bench_go);   // Releases the producers
+static DECLARE_COMPLETION(bench_done); // Last handler of a run
+static atomic_long_t bench_remaining;
+static u64 bench_end_ns;
+
+static struct workqueue_struct *bench_unbound_wq;
+static struct kthread_worker *bench_kworker;
+static bool (*bench_queue_simple)(simple_work_t *work);
+
+// --- Handlers ---
+
+// Common body of every handler
+static void bench_item_ran(struct bench_item *item)
+{
+    u64 now = ktime_get_ns();
+
+    item->start_ns = now;
+    if (bench_work_ns) {
+        while (ktime_get_ns() - now < bench_work_ns)
+            cpu_relax();
+    }
+    if (atomic_long_dec_and_test(&bench_remaining)) {
+        WRITE_ONCE(bench_end_ns, ktime_get_ns());
+        complete(&bench_done);
+    }
+}
+
+static void bench_tasklet_fn(struct tasklet_struct *t)
+{
+    bench_item_ran(container_of(t, struct bench_item, tasklet));
+}
+
+static void bench_work_fn(struct work_struct *work)
+{
+    bench_item_ran(container_of(work, struct bench_item, work));
+}
+
+static void bench_dwork_fn(struct work_struct *work)
+{
+    bench_item_ran(container_of(to_delayed_work(work), struct bench_item, dwork));
+}
+
+static void bench_kwork_fn(struct kthread_work *work)
+{
+    bench_item_ran(container_of(work, struct bench_item, kwork));
+}
+
+static void bench_irq_work_fn(struct irq_work *iw)
+{
+    bench_item_ran(container_of(iw, struct bench_item, iw));
+}
+
+static void bench_simple_fn(void *data)
+{
+    bench_item_ran(container_of(data, struct bench_item, swork));
+}
+
+// --- Mechanisms ---
+
+static void bench_tasklet_init(struct bench_item *item)
+{
+    tasklet_setup(&item->tasklet, bench_tasklet_fn);
+}
+
+static void bench_tasklet_submit(struct bench_item *item)
+{
+    tasklet_schedule(&item->tasklet);
+}
+
+static void bench_hi_tasklet_submit(struct bench_item *item)
+{
+    tasklet_hi_schedule(&item->tasklet);
+}
+
+static void bench_tasklet_sync(struct bench_item *item)
+{
+    tasklet_kill(&item->tasklet);
+}
+
+static int bench_simple_setup(void)
+{
+    bench_queue_simple = symbol_get(queue_simple_work);
+    return bench_queue_simple ? 0 : -ENODEV;
+}
+
+static void bench_simple_teardown(void)
+{
+    symbol_put(queue_simple_work);
+    bench_queue_simple = NULL;
+}
+
+static void bench_simple_init(struct bench_item *item)
+{
+    INIT_SIMPLE_WORK(&item->swork, bench_simple_fn);
+}
+
+static void bench_simple_submit(struct bench_item *item)
+{
+    bench_queue_simple(&item->swork);
+}
+
+static void bench_work_init(struct bench_item *item)
+{
+    INIT_WORK(&item->work, bench_work_fn);
+}
+
+static void bench_system_wq_submit(struct bench_item *item)
+{
+    queue_work(system_wq, &item->work);
+}
+
+static void bench_work_sync(struct bench_item *item)
+{
+    cancel_work_sync(&item->work);
+}
+
+static int bench_unbound_setup(void)
+{
+    bench_unbound_wq = alloc_workqueue("defer_bench_unbound", WQ_UNBOUND, 0);
+    return bench_unbound_wq ? 0 : -ENOMEM;
+}
+
+static void bench_unbound_teardown(void)
+{
+    destroy_workqueue(bench_unbound_wq);
+    bench_unbound_wq = NULL;
+}
+
+static void bench_unbound_submit(struct bench_item *item)
+{
+    queue_work(bench_unbound_wq, &item->work);
+}
+
+static void bench_dwork_init(struct bench_item *item)
+{
+    INIT_DELAYED_WORK(&item->dwork, bench_dwork_fn);
+}
+
+static void bench_dwork_submit(struct bench_item *item)
+{
+    queue_delayed_work(system_wq, &item->dwork, 1);
+}
+
+static void bench_dwork_sync(struct bench_item *item)
+{
+    cancel_delayed_work_sync(&item->dwork);
+}
+
+static int bench_kworker_setup(void)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 14, 0)
+    bench_kworker = kthread_run_worker(0, "defer_bench_kworker");
+#else
+    bench_kworker = kthread_create_worker(0, "defer_bench_kworker");
+#endif
+    if (IS_ERR(bench_kworker)) {
+        int ret = PTR_ERR(bench_kworker);
+
+        bench_kworker = NULL;
+        return ret;
+    }
+    return 0;
+}
+
+static void bench_kworker_teardown(void)
+{
+    kthread_destroy_worker(bench_kworker);
+    bench_kworker = NULL;
+}
+
+static void bench_kwork_init(struct bench_item *item)
+{
+    kthread_init_work(&item->kwork, bench_kwork_fn);
+}
+
+static void bench_kwork_submit(struct bench_item *item)
+{
+    kthread_queue_work(bench_kworker, &item->kwork);
+}
+
+static void bench_kwork_sync(struct bench_item *item)
+{
+    kthread_cancel_work_sync(&item->kwork);
+}
+
+static void bench_irq_work_init(struct bench_item *item)
+{
+    init_irq_work(&item->iw, bench_irq_work_fn);
+}
+
+static void bench_irq_work_submit(struct bench_item *item)
+{
+    irq_work_queue(&item->iw);
+}
+
+static void bench_irq_work_sync(struct bench_item *item)
+{
+    irq_work_sync(&item->iw);
+}
+
+static const struct bench_mech bench_mechs[] = {
+    { "tasklet", NULL, NULL, bench_tasklet_init, bench_tasklet_submit, bench_tasklet_sync },
+    { "hi_tasklet", NULL, NULL, bench_tasklet_init, bench_hi_tasklet_submit, bench_tasklet_sync },
+    // SimpleWQ cannot cancel embedded items; a run only ends once all ran
+    { "simplewq", bench_simple_setup, bench_simple_teardown, bench_simple_init,
+      bench_simple_submit, NULL },
+    { "system_wq", NULL, NULL, bench_work_init, bench_system_wq_submit, bench_work_sync },
+    { "unbound_wq", bench_unbound_setup, bench_unbound_teardown, bench_work_init,
+      bench_unbound_submit, bench_work_sync },
+    { "delayed_work", NULL, NULL, bench_dwork_init, bench_dwork_submit, bench_dwork_sync },
+    { "kthread_worker", bench_kworker_setup, bench_kworker_teardown, bench_kwork_init,
+      bench_kwork_submit, bench_kwork_sync },
+    { "irq_work", NULL, NULL, bench_irq_work_init, bench_irq_work_submit, bench_irq_work_sync },
+};
+
+// --- Runs ---
+
+static int bench_producer_fn(void *arg)
+{
+    struct bench_producer *prod = arg;
+    const struct bench_mech *mech = prod->mech;
+    struct bench_item *item;
+    unsigned int i;
+    u64 t0, t1, total = 0;
+
+    wait_for_completion(&bench_go);
+    for (i = 0; i < prod->nr; i++) {
+        item = &prod->items[i];
+        t0 = ktime_get_ns();
+        item->submit_ns = t0;
+        mech->submit(item);
+        t1 = ktime_get_ns();
+        total += t1 - t0;
+    }
+    prod->submit_ns = total;
+
+    // Stay around for kthread_stop(), so the task is still ours to stop
+    set_current_state(TASK_INTERRUPTIBLE);
+    while (!kthread_should_stop()) {
+        schedule();
+        set_current_state(TASK_INTERRUPTIBLE);
+    }
+    __set_current_state(TASK_RUNNING);
+    return 0;
+}
+
+// One mechanism at one producer count. items and lat hold nr_prod *
+// per_prod entries.
+static int bench_run_one(const struct bench_mech *mech, unsigned int nr_prod,
+                         unsigned int per_prod, struct bench_item *items, u64 *lat)
+{
+    struct bench_result *res = &bench_results[bench_nr_results];
+    struct bench_producer *prods;
+    unsigned long i, n = (unsigned long)nr_prod * per_prod;
+    u64 start_ns, submit_ns = 0;
+    unsigned int p, started = 0;
+    long left;
+    int ret = 0;
+
+    if (bench_nr_results == BENCH_MAX_RESULTS)
+        return -ENOSPC;
+    prods = kcalloc(nr_prod, sizeof(*prods), GFP_KERNEL);
+    if (!prods)
+        return -ENOMEM;
+
+    memset(items, 0, n * sizeof(*items));
+    for (i = 0; i < n; i++)
+        mech->init(&items[i]);
+    reinit_completion(&bench_go);
+    reinit_completion(&bench_done);
+    atomic_long_set(&bench_remaining, n);
+
+    for (p = 0; p < nr_prod; p++) {
+        prods[p].mech = mech;
+        prods[p].items = &items[(unsigned long)p * per_prod];
+        prods[p].nr = per_prod;
+        prods[p].task = kthread_run(bench_producer_fn, &prods[p], "defer_bench/%u", p);
+        if (IS_ERR(prods[p].task)) {
+            ret = PTR_ERR(prods[p].task);
+            break;
+        }
+        started++;
+    }
+    // Release whoever started; a failed run still has to drain
+    if (started < nr_prod)
+        atomic_long_sub((unsigned long)(nr_prod - started) * per_prod, &bench_remaining);
+
+    start_ns = ktime_get_ns();
+    complete_all(&bench_go);
+    left = started ? wait_for_completion_timeout(&bench_done, BENCH_TIMEOUT) : 1;
+    for (p = 0; p < started; p++) {
+        kthread_stop(prods[p].task);
+        submit_ns += prods[p].submit_ns;
+    }
+    if (!left) {
+        pr_err("defer_bench: %s with %u producers timed out, %ld items outstanding\n",
+               mech->name, nr_prod, atomic_long_read(&bench_remaining));
+        ret = -ETIMEDOUT;
+    }
+    if (mech->sync) {
+        for (i = 0; i < n; i++)
+            mech->sync(&items[i]);
+    } else if (!left) {
+        // Nothing to cancel with: wait until the stragglers have run
+        wait_for_completion(&bench_done);
+    }
+
+    if (!ret) {
+        for (i = 0; i < n; i++)
+            lat[i] = items[i].start_ns - items[i].submit_ns;
+        defer_samples_sort(lat, n);
+
+        res->mech = mech->name;
+        res->producers = nr_prod;
+        res->items = n;
+        res->submit_ns = div64_u64(submit_ns, n);
+        res->p50_ns = defer_sample_percentile(lat, n, 5000);
+        res->p90_ns = defer_sample_percentile(lat, n, 9000);
+        res->p99_ns = defer_sample_percentile(lat, n, 9900);
+        res->max_ns = lat[n - 1];
+        res->per_sec = div64_u64((u64)n * NSEC_PER_SEC,
+                                 max(READ_ONCE(bench_end_ns) - start_ns, 1ULL));
+        bench_nr_results++;
+        defer_dbg("defer_bench: %s x%u: submit %llu ns, p50 %llu ns, %llu items/s\n",
+                  mech->name, nr_prod, res->submit_ns, res->p50_ns, res->per_sec);
+    }
+    kfree(prods);
+    return ret;
+}
+
+static int bench_run(void)
+{
+    unsigned int per_prod = min(bench_items, BENCH_MAX_ITEMS);
+    unsigned int top = clamp(max_producers, 1U, (unsigned int)BENCH_MAX_PRODUCERS);
+    unsigned long n = (unsigned long)top * per_prod;
+    const struct bench_mech *mech;
+    struct bench_item *items;
+    unsigned int m, p;
+    u64 *lat;
+    int ret = 0;
+
+    if (!per_prod)
+        return -EINVAL;
+    items = kvcalloc(n, sizeof(*items), GFP_KERNEL);
+    lat = kvcalloc(n, sizeof(*lat), GFP_KERNEL);
+    if (!items || !lat) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    mutex_lock(&bench_lock);
+    bench_nr_results = 0;
+    for (m = 0; m < ARRAY_SIZE(bench_mechs) && !ret; m++) {
+        mech = &bench_mechs[m];
+        if (mech->setup) {
+            ret = mech->setup();
+            if (ret == -ENODEV) {
+                pr_info("defer_bench: %s not available, skipped.\n", mech->name);
+                ret = 0;
+                continue;
+            }
+            if (ret)
+                break;
+        }
+        // 1, 2, 4, ... and finally top itself
+        for (p = 1; !ret; p = min(p * 2, top)) {
+            ret = bench_run_one(mech, p, per_prod, items, lat);
+            if (p == top)
+                break;
+        }
+        if (mech->teardown)
+            mech->teardown();
+    }
+    mutex_unlock(&bench_lock);
+    pr_info("defer_bench: %u runs completed.\n", bench_nr_results);
+out:
+    kvfree(lat);
+    kvfree(items);
+    return ret;
+}
+
+// --- debugfs ---
+
+DEFINE_DEFER_RUN_FOPS(bench_run_fops, bench_run);
+
+static int bench_results_show(struct seq_file *m, void *v)
+{
+    struct bench_result *res;
+    unsigned int i;
+
+    seq_printf(m, "%-15s %9s %9s %9s %9s %9s %9s %11s %13s\n", "mechanism", "producers",
+               "items", "submit_ns", "p50_ns", "p90_ns", "p99_ns", "max_ns", "items_per_sec");
+    mutex_lock(&bench_lock);
+    for (i = 0; i < bench_nr_results; i++) {
+        res = &bench_results[i];
+        seq_printf(m, "%-15s %9u %9lu %9llu %9llu %9llu %9llu %11llu %13llu\n",
+                   res->mech, res->producers, res->items, res->submit_ns,
+                   res->p50_ns, res->p90_ns, res->p99_ns, res->max_ns, res->per_sec);
+    }
+    mutex_unlock(&bench_lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(bench_results);
+
+static int __init defer_bench_init(void)
+{
+    pr_info("defer_bench: Loading...\n");
+
+    bench_debugfs_dir = debugfs_create_dir("defer_bench", NULL);
+    debugfs_create_file("run", 0200, bench_debugfs_dir, NULL, &bench_run_fops);
+    debugfs_create_file("results", 0444, bench_debugfs_dir, NULL, &bench_results_fops);
+
+    pr_info("defer_bench: echo run > /sys/kernel/debug/defer_bench/run to start.\n");
+    return 0;
+}
+
+static void __exit defer_bench_exit(void)
+{
+    debugfs_remove_recursive(bench_debugfs_dir);
+    pr_info("defer_bench: Unloaded.\n");
+}
+
+module_init(defer_bench_init);
+module_exit(defer_bench_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Oliver Jędrzejczyk");
+MODULE_DESCRIPTION("Deferred-work mechanism latency and throughput comparison");
+MODULE_VERSION("1.0");
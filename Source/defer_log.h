@@ -0,0 +1,61 @@
+#ifndef _DEFER_LOG_H
+#define _DEFER_LOG_H
+
+#include <linux/jump_label.h> // Static keys
+#include <linux/moduleparam.h>
+#include <linux/printk.h>     // pr_info
+#include <linux/kstrtox.h>    // kstrtobool
+
+// Hot-path logging for the deferred-work modules.
+//
+// A pr_info() per handler run or per submit costs more than the work
+// itself, so those messages go through defer_dbg(). It is a static key
+// branch, patched to a no-op until the module's "verbose" parameter is
+// set (at load time or later through /sys/module/<name>/parameters).
+// Building with -DDEFER_NO_HOTPATH_LOG removes the messages entirely.
+//
+// The module's source file expands DEFINE_DEFER_VERBOSE() before its first
+// defer_dbg(). The key is static, so modules built into the same kernel
+// (see Kbuild) each keep their own.
+
+#ifdef DEFER_NO_HOTPATH_LOG
+#define defer_dbg(fmt, ...) no_printk(fmt, ##__VA_ARGS__)
+#else
+#define defer_dbg(fmt, ...)                               \
+    do {                                                  \
+        if (static_branch_unlikely(&defer_verbose_key))   \
+            pr_info(fmt, ##__VA_ARGS__);                  \
+    } while (0)
+#endif
+
+#define DEFINE_DEFER_VERBOSE()                                                  \
+    static DEFINE_STATIC_KEY_FALSE(defer_verbose_key);                          \
+                                                                                \
+    static int defer_verbose_set(const char *val, const struct kernel_param *kp) \
+    {                                                                           \
+        bool on;                                                                \
+        int ret = kstrtobool(val, &on);                                         \
+                                                                                \
+        if (ret)                                                                \
+            return ret;                                                         \
+        if (on)                                                                 \
+            static_branch_enable(&defer_verbose_key);                           \
+        else                                                                    \
+            static_branch_disable(&defer_verbose_key);                          \
+        return 0;                                                               \
+    }                                                                           \
+                                                                                \
+    static int defer_verbose_get(char *buf, const struct kernel_param *kp)      \
+    {                                                                           \
+        return sprintf(buf, "%c\n",                                             \
+                       static_key_enabled(&defer_verbose_key) ? 'Y' : 'N');     \
+    }                                                                           \
+                                                                                \
+    static const struct kernel_param_ops defer_verbose_ops = {                  \
+        .set = defer_verbose_set,                                               \
+        .get = defer_verbose_get,                                               \
+    };                                                                          \
+    module_param_cb(verbose, &defer_verbose_ops, NULL, 0644);                   \
+    MODULE_PARM_DESC(verbose, "Log every deferred item with pr_info (hot path)")
+
+#endif // _DEFER_LOG_H
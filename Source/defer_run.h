@@ -0,0 +1,47 @@
+#ifndef _DEFER_RUN_H
+#define _DEFER_RUN_H
+
+#include <linux/fs.h>         // struct file_operations
+#include <linux/module.h>     // THIS_MODULE
+#include <linux/uaccess.h>    // copy_from_user
+#include <linux/string.h>     // sysfs_streq
+
+// Write-only debugfs trigger shared by the benchmark modules. Writing
+// "run" calls the module's run function and fails the write with its
+// error, if any; anything else is -EINVAL.
+//
+//     DEFINE_DEFER_RUN_FOPS(ex7_bench_run_fops, ex7_bench_run);
+//     debugfs_create_file("run", 0200, dir, NULL, &ex7_bench_run_fops);
+
+static inline ssize_t defer_run_write(const char __user *ubuf, size_t count,
+                                      int (*run)(void))
+{
+    char buf[16];
+    int ret;
+
+    if (count >= sizeof(buf))
+        return -EINVAL;
+    if (copy_from_user(buf, ubuf, count))
+        return -EFAULT;
+    buf[count] = '\0';
+
+    if (!sysfs_streq(buf, "run"))
+        return -EINVAL;
+
+    ret = run();
+    return ret ? ret : count;
+}
+
+#define DEFINE_DEFER_RUN_FOPS(name, run)                                            \
+    static ssize_t name##_write(struct file *file, const char __user *ubuf,         \
+                                size_t count, loff_t *ppos)                         \
+    {                                                                               \
+        return defer_run_write(ubuf, count, run);                                   \
+    }                                                                               \
+                                                                                    \
+    static const struct file_operations name = {                                    \
+        .owner = THIS_MODULE,                                                       \
+        .write = name##_write,                                                      \
+    }
+
+#endif // _DEFER_RUN_H
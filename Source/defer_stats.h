@@ -0,0 +1,57 @@
+#ifndef _DEFER_STATS_H
+#define _DEFER_STATS_H
+
+#include <linux/types.h>      // u64
+#include <linux/math.h>       // DIV_ROUND_UP_ULL
+#include <linux/compiler.h>   // READ_ONCE
+#include <linux/math64.h>     // div_u64
+#include <linux/sort.h>       // Sorted latency samples
+
+// Latency statistics shared by the deferred-work modules.
+//
+// Long-running modules keep latencies in log2 histograms: bucket i counts
+// values of 2^i..2^(i+1)-1 ns (bucket 0 also takes 0), and the last bucket
+// takes everything above. Benchmarks keep every sample and sort them.
+// Percentiles are given in hundredths of a percent, so 5000 is p50 and
+// 9990 is p99.9.
+
+// Upper bound (ns) of the bucket holding the given percentile. Returns 0
+// for an empty histogram. Counters may be updated concurrently.
+static inline u64 defer_hist_percentile(const unsigned long *hist, unsigned int nr_buckets,
+                                        unsigned long total, unsigned int pct100)
+{
+    unsigned long seen = 0;
+    u64 want;
+    unsigned int i;
+
+    if (!total)
+        return 0;
+    want = DIV_ROUND_UP_ULL((u64)total * pct100, 10000);
+    for (i = 0; i < nr_buckets; i++) {
+        seen += READ_ONCE(hist[i]);
+        if (seen >= want)
+            return 2ULL << i;
+    }
+    return 2ULL << (nr_buckets - 1);
+}
+
+static inline int defer_u64_cmp(const void *a, const void *b)
+{
+    u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+// Sort n samples in place for defer_sample_percentile()
+static inline void defer_samples_sort(u64 *lat, unsigned int n)
+{
+    sort(lat, n, sizeof(*lat), defer_u64_cmp, NULL);
+}
+
+// The given percentile of n sorted samples; n must not be 0
+static inline u64 defer_sample_percentile(const u64 *lat, unsigned int n, unsigned int pct100)
+{
+    return lat[div_u64((u64)(n - 1) * pct100, 10000)];
+}
+
+#endif // _DEFER_STATS_H
@@ -0,0 +1,95 @@
+#ifndef _DEFER_TEST_H
+#define _DEFER_TEST_H
+
+#include <kunit/test.h>
+#include <linux/atomic.h>
+#include <linux/completion.h>
+#include <linux/moduleparam.h>
+#include <linux/math64.h>       // div_u64
+#include <linux/timekeeping.h>  // ktime_get_ns
+
+// KUnit fixture shared by the deferred-work test suites (ex3_test.c,
+// ex6_test.c).
+//
+// A case queues nr items keyed 0..nr-1; its handler calls
+// defer_test_record() with the key of every item that runs. The case then
+// waits for all of them, checks they ran in key order, and reports the
+// queueing and drain cost per item against the suite's budgets (0 means
+// report only, e.g. ex3.kunit_drain_budget_ns=2000 on the kunit.py
+// --kernel_args command line).
+
+#define DEFER_TEST_TIMEOUT (10 * HZ)
+
+static unsigned int kunit_drain_budget_ns;
+module_param(kunit_drain_budget_ns, uint, 0644);
+MODULE_PARM_DESC(kunit_drain_budget_ns, "KUnit: fail if draining costs more than this per item (ns, 0 = report only)");
+
+struct defer_test_ctx {
+    unsigned int nr;
+    unsigned long *order; // order[i]: key of the i-th item to run
+    atomic_t ran;
+    u64 last_ns;          // When the last item ran
+    struct completion done;
+};
+
+static inline void defer_test_ctx_init(struct kunit *test, struct defer_test_ctx *ctx,
+                                       unsigned int nr)
+{
+    ctx->order = kunit_kcalloc(test, nr, sizeof(*ctx->order), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, ctx->order);
+    ctx->nr = nr;
+    atomic_set(&ctx->ran, 0);
+    init_completion(&ctx->done);
+}
+
+static inline void defer_test_record(struct defer_test_ctx *ctx, unsigned long key)
+{
+    int i = atomic_inc_return(&ctx->ran) - 1;
+
+    if (i < ctx->nr)
+        ctx->order[i] = key;
+    if (i + 1 == ctx->nr) {
+        ctx->last_ns = ktime_get_ns();
+        complete(&ctx->done);
+    }
+}
+
+// Wait for every item of ctx to run; fails the case on timeout
+static inline bool defer_test_wait(struct kunit *test, struct defer_test_ctx *ctx)
+{
+    if (wait_for_completion_timeout(&ctx->done, DEFER_TEST_TIMEOUT))
+        return true;
+
+    KUNIT_FAIL(test, "only %d of %u items ran", atomic_read(&ctx->ran), ctx->nr);
+    return false;
+}
+
+static inline void defer_test_check_order(struct kunit *test, const struct defer_test_ctx *ctx)
+{
+    unsigned int i;
+
+    for (i = 0; i < ctx->nr; i++) {
+        KUNIT_EXPECT_EQ_MSG(test, ctx->order[i], (unsigned long)i,
+                            "item %lu ran at position %u", ctx->order[i], i);
+        if (ctx->order[i] != i)
+            break; // One message is enough
+    }
+}
+
+// Queueing cost per item (t0..t1) and drain time per item (t0..last run)
+static inline void defer_test_report(struct kunit *test, const struct defer_test_ctx *ctx,
+                                     const char *what, u64 t0, u64 t1,
+                                     unsigned int queue_budget_ns)
+{
+    u64 queue = div_u64(t1 - t0, ctx->nr);
+    u64 drain = div_u64(ctx->last_ns - t0, ctx->nr);
+
+    kunit_info(test, "%s queue: %llu ns/item, drain: %llu ns/item (%u items)\n",
+               what, queue, drain, ctx->nr);
+    if (queue_budget_ns)
+        KUNIT_EXPECT_LE(test, queue, (u64)queue_budget_ns);
+    if (kunit_drain_budget_ns)
+        KUNIT_EXPECT_LE(test, drain, (u64)kunit_drain_budget_ns);
+}
+
+#endif // _DEFER_TEST_H
@@ -0,0 +1,107 @@
+// Trace events shared by the deferred-work modules (tasklets and work queues).
+//
+// Each module picks its own trace system so several of them can be loaded
+// at once, then creates the events in exactly one of its source files:
+//
+//     #define DEFER_TRACE_SYSTEM ex6
+//     #define CREATE_TRACE_POINTS
+//     #include "defer_trace.h"
+//
+// The module's Kbuild line needs -I$(src) so define_trace.h can find this
+// file again (CFLAGS_ex6.o := -I$(src)).
+//
+// Every item goes through schedule -> start -> end (-> free when the item
+// itself is released). Tools/defer_latency.py pairs the events by item
+// pointer and turns a trace into per-mechanism latency reports.
+//
+// Trace events live in a single kernel-wide namespace, so two modules built
+// into the same kernel (the KUnit build, see Kbuild) cannot both define
+// them. Building with -DDEFER_NO_TRACE turns the events into no-ops.
+
+#ifdef DEFER_NO_TRACE
+
+#ifndef _DEFER_TRACE_STUBS_H
+#define _DEFER_TRACE_STUBS_H
+
+static inline void trace_defer_schedule(const void *item, unsigned long data, bool high_prio) {}
+static inline void trace_defer_start(const void *item, unsigned long data, bool high_prio) {}
+static inline void trace_defer_end(const void *item, unsigned long data, bool high_prio) {}
+static inline void trace_defer_free(const void *item, unsigned long data, bool high_prio) {}
+
+#endif // _DEFER_TRACE_STUBS_H
+
+#undef CREATE_TRACE_POINTS
+
+#else // !DEFER_NO_TRACE
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM DEFER_TRACE_SYSTEM
+
+#if !defined(_DEFER_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _DEFER_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/string.h>
+
+// Length of the mechanism name stored in each event (module name)
+#define DEFER_TRACE_MECH_LEN 8
+
+DECLARE_EVENT_CLASS(defer_item,
+
+    TP_PROTO(const void *item, unsigned long data, bool high_prio),
+
+    TP_ARGS(item, data, high_prio),
+
+    TP_STRUCT__entry(
+        __array(char, mech, DEFER_TRACE_MECH_LEN)
+        __field(const void *, item)
+        __field(unsigned long, data)
+        __field(bool, high_prio)
+    ),
+
+    TP_fast_assign(
+        strscpy(__entry->mech, KBUILD_MODNAME, DEFER_TRACE_MECH_LEN);
+        __entry->item = item;
+        __entry->data = data;
+        __entry->high_prio = high_prio;
+    ),
+
+    TP_printk("mech=%s item=%p data=%lu hi=%d",
+              __entry->mech, __entry->item, __entry->data, __entry->high_prio)
+);
+
+// Item handed to the deferral mechanism (tasklet_schedule, queue_work, ...)
+DEFINE_EVENT(defer_item, defer_schedule,
+    TP_PROTO(const void *item, unsigned long data, bool high_prio),
+    TP_ARGS(item, data, high_prio)
+);
+
+// Handler entered
+DEFINE_EVENT(defer_item, defer_start,
+    TP_PROTO(const void *item, unsigned long data, bool high_prio),
+    TP_ARGS(item, data, high_prio)
+);
+
+// Handler returned
+DEFINE_EVENT(defer_item, defer_end,
+    TP_PROTO(const void *item, unsigned long data, bool high_prio),
+    TP_ARGS(item, data, high_prio)
+);
+
+// Item memory released (or the item killed for good)
+DEFINE_EVENT(defer_item, defer_free,
+    TP_PROTO(const void *item, unsigned long data, bool high_prio),
+    TP_ARGS(item, data, high_prio)
+);
+
+#endif // _DEFER_TRACE_H
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE defer_trace
+
+// This part must be outside protection
+#include <trace/define_trace.h>
+
+#endif // DEFER_NO_TRACE
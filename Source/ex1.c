@@ -2,22 +2,69 @@
 #include <linux/init.h>
 #include <linux/interrupt.h> // tasklet API
 #include <linux/printk.h>    // pr_info
+#include "defer_log.h"       // defer_dbg, verbose parameter
+#include "tasklet_dispatch.h" // CPU steering, dispatch parameter
+#include "tasklet_gate.h"    // Per-schedule payloads
+
+#define DEFER_TRACE_SYSTEM ex1
+#define CREATE_TRACE_POINTS
+#include "defer_trace.h"     // defer_schedule/start/end/free events
+
+DEFINE_DEFER_VERBOSE();
+DEFINE_TASKLET_DISPATCHER(ex1_dispatch);
+DEFINE_TASKLET_GATE(ex1_gate);
 
 // Tasklet handler function
+static void ex1_tasklet_handler(unsigned long data);
+
+// Statically declare a tasklet, initially disabled
+static DECLARE_TASKLET_DISABLED(ex1_tasklet, ex1_tasklet_handler, 123);
+static struct tasklet_dispatch_req ex1_req = TASKLET_DISPATCH_REQ_INIT(&ex1_tasklet, false);
+
 static void ex1_tasklet_handler(unsigned long data)
 {
-    pr_info("Ex1 Tasklet: Handler executing with data: %lu\n", data);
+    unsigned int i, n;
+
+    tasklet_dispatch_ran(&ex1_dispatch, &ex1_req);
+    // Every payload pushed since the last run, including the ones queued
+    // while the tasklet was disabled
+    n = tasklet_gate_collect(&ex1_gate);
+    trace_defer_start(&ex1_tasklet, data, false);
+    defer_dbg("Ex1 Tasklet: Handler executing with data: %lu, %u payloads (%u schedules coalesced)\n",
+              data, n, n ? n - 1 : 0);
+    for (i = 0; i < n; i++)
+        defer_dbg("Ex1 Tasklet:   payload %lu\n", ex1_gate.vec[i]);
+    trace_defer_end(&ex1_tasklet, data, false);
 }
 
-// Statically declare a tasklet, initially disabled
-static DECLARE_TASKLET_DISABLED(ex1_tasklet, ex1_tasklet_handler, 123);
+// Queue payload, then tasklet_schedule() on the CPU picked by the dispatch
+// policy, plus the trace event
+static void ex1_schedule(unsigned long payload)
+{
+    int cpu;
+
+    if (!tasklet_gate_push(&ex1_gate, payload))
+        pr_warn("Ex1 Module: Payload %lu dropped, gate ring full\n", payload);
+    trace_defer_schedule(&ex1_tasklet, payload, false);
+    cpu = tasklet_dispatch(&ex1_dispatch, &ex1_req);
+    defer_dbg("Ex1 Module: Tasklet dispatched to CPU %d\n", cpu);
+}
 
 static int __init ex1_init(void)
 {
+    int ret;
+
     pr_info("Ex1 Module: Loading...\n");
+    ret = tasklet_dispatcher_init(&ex1_dispatch);
+    if (ret)
+        return ret;
+    if (tasklet_gate_init(&ex1_gate)) {
+        tasklet_dispatcher_destroy(&ex1_dispatch);
+        return -ENOMEM;
+    }
 
     // Schedule the disabled tasklet. It shouldn't run yet.
-    tasklet_schedule(&ex1_tasklet);
+    ex1_schedule(1);
     pr_info("Ex1 Module: Tasklet scheduled (but disabled).\n");
 
     // Check if still disabled (note: no direct API to check, we infer)
@@ -28,7 +75,7 @@ static int __init ex1_init(void)
     // At this point, the previously scheduled tasklet should execute.
 
     // Schedule it again, it should run now as it's enabled
-    tasklet_schedule(&ex1_tasklet);
+    ex1_schedule(2);
     pr_info("Ex1 Module: Tasklet scheduled again (now enabled).\n");
 
     // Disable it again (waits if running - handler is fast anyway)
@@ -36,17 +83,21 @@ static int __init ex1_init(void)
     tasklet_disable(&ex1_tasklet);
     pr_info("Ex1 Module: Tasklet disabled (sync).\n");
 
-    // Try scheduling while disabled - should have no effect until enabled
-    tasklet_schedule(&ex1_tasklet);
-    pr_info("Ex1 Module: Tasklet scheduled while disabled (no effect yet).\n");
+    // Try scheduling while disabled - should have no effect until enabled.
+    // The schedules collapse into one run, but the gate keeps each payload.
+    ex1_schedule(3);
+    ex1_schedule(4);
+    ex1_schedule(5);
+    pr_info("Ex1 Module: Tasklet scheduled 3 times while disabled (no effect yet).\n");
 
-    // Enable it again - the schedule above should now take effect
+    // Enable it again - the schedules above should now take effect as one
+    // run that receives payloads 3, 4 and 5
     pr_info("Ex1 Module: Enabling tasklet again...\n");
     tasklet_enable(&ex1_tasklet);
     pr_info("Ex1 Module: Tasklet enabled again. Should run soon.\n");
 
     // Schedule one more time
-    tasklet_schedule(&ex1_tasklet);
+    ex1_schedule(6);
     pr_info("Ex1 Module: Tasklet scheduled one last time.\n");
 
     // Disable without waiting (nosync)
@@ -66,10 +117,18 @@ static void __exit ex1_exit(void)
 {
     pr_info("Ex1 Module: Exiting...\n");
 
+    // No irq_work may schedule the tasklet behind tasklet_kill()'s back
+    tasklet_dispatcher_sync(&ex1_dispatch);
+
     // Ensure the tasklet is removed from the queue and won't run after unload
     // Waits if the tasklet is currently running.
     tasklet_kill(&ex1_tasklet);
+    trace_defer_free(&ex1_tasklet, 123, false);
     pr_info("Ex1 Module: Tasklet killed.\n");
+    tasklet_dispatch_report(&ex1_dispatch, "Ex1 Module");
+    tasklet_gate_report(&ex1_gate, "Ex1 Module");
+    tasklet_gate_destroy(&ex1_gate);
+    tasklet_dispatcher_destroy(&ex1_dispatch);
     pr_info("Ex1 Module: Unloaded.\n");
 }
 
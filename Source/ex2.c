@@ -2,51 +2,391 @@
 #include <linux/init.h>
 #include <linux/interrupt.h> // tasklet API
 #include <linux/printk.h>    // pr_info
+#include <linux/kfifo.h>     // Producer ring
+#include <linux/kthread.h>   // Producer and poll threads
+#include <linux/delay.h>     // usleep_range, ndelay
+#include <linux/ktime.h>     // ktime_get_ns
+#include <linux/proc_fs.h>   // Proc filesystem
+#include <linux/seq_file.h>  // seq_file API for proc
+#include "defer_log.h"       // defer_dbg, verbose parameter
+#include "tasklet_dispatch.h" // CPU steering, dispatch parameter
+
+#define DEFER_TRACE_SYSTEM ex2
+#define CREATE_TRACE_POINTS
+#include "defer_trace.h"     // defer_schedule/start/end/free events
+
+DEFINE_DEFER_VERBOSE();
+DEFINE_TASKLET_DISPATCHER(ex2_dispatch);
+
+// NAPI-style poll engine. A producer thread fills a ring and kicks the
+// tasklet; each tasklet run drains up to "budget" items or "time_limit_us",
+// whichever comes first, and reschedules itself only if work remains.
+// After "handoff_after" consecutive exhausted runs the backlog is handed
+// to a kthread, which keeps draining in process context (so ksoftirqd and
+// the rest of the softirqs are not starved) until the ring is empty, then
+// hands polling back to the tasklet.
+//
+// Exactly one consumer owns the ring at a time: whoever set EX2_SCHED.
+// The producer is the only writer, so the kfifo needs no lock.
+
+#define PROC_FILENAME "ex2_poll_stats"
+
+#define EX2_RING_ORDER_MAX 20 // 1M items
+
+static unsigned int ring_order = 12;
+module_param(ring_order, uint, 0444);
+MODULE_PARM_DESC(ring_order, "Producer ring holds 2^ring_order items (1-20)");
+
+static unsigned int budget = 64;
+module_param(budget, uint, 0644);
+MODULE_PARM_DESC(budget, "Max items per tasklet run");
+
+static unsigned int time_limit_us = 2000;
+module_param(time_limit_us, uint, 0644);
+MODULE_PARM_DESC(time_limit_us, "Max time per tasklet run (us)");
+
+static unsigned int handoff_after = 3;
+module_param(handoff_after, uint, 0644);
+MODULE_PARM_DESC(handoff_after, "Consecutive exhausted runs before handing off to the kthread");
+
+static unsigned int burst = 256;
+module_param(burst, uint, 0644);
+MODULE_PARM_DESC(burst, "Items the producer enqueues per wakeup");
+
+static unsigned int produce_us = 1000;
+module_param(produce_us, uint, 0644);
+MODULE_PARM_DESC(produce_us, "Producer sleep between bursts (us)");
+
+static unsigned int nr_items = 100000;
+module_param(nr_items, uint, 0444);
+MODULE_PARM_DESC(nr_items, "Items to produce in total (0 = unlimited)");
+
+static unsigned int work_ns;
+module_param(work_ns, uint, 0644);
+MODULE_PARM_DESC(work_ns, "Simulated cost of one item (ns)");
+
+enum {
+    EX2_SCHED, // A consumer (tasklet or thread) owns the ring
+};
+
+static DECLARE_KFIFO_PTR(ex2_ring, u32);
+static unsigned long ex2_state;
+static bool ex2_threaded;  // Ring owned by ex2_poll_task rather than the tasklet
+static bool ex2_stopping;
+static unsigned int ex2_exhausted; // Consecutive exhausted tasklet runs
+static u32 ex2_checksum;
+static struct task_struct *ex2_producer_task;
+static struct task_struct *ex2_poll_task;
+
+// Producer fields are written by the producer, the rest by the current
+// ring owner; /proc reads everything locklessly
+static struct {
+    unsigned long produced;
+    unsigned long dropped;    // Ring full
+    unsigned long kicks;      // Producer scheduled the tasklet
+    unsigned long runs;       // Tasklet runs
+    unsigned long items;      // Items processed in softirq
+    unsigned long max_items;  // Most items in one run
+    unsigned long budget_exits;
+    unsigned long time_exits;
+    unsigned long handoffs;
+    unsigned long thread_items;
+    u64 softirq_ns;           // Time spent inside tasklet runs
+    u64 max_run_ns;
+} ex2_stats;
+
+#define EX2_STAT_ADD(field, n) WRITE_ONCE(ex2_stats.field, ex2_stats.field + (n))
 
 // Forward declaration needed since the handler uses the tasklet struct
 static struct tasklet_struct ex2_tasklet;
+static struct tasklet_dispatch_req ex2_req = TASKLET_DISPATCH_REQ_INIT(&ex2_tasklet, false);
+
+// Process up to max items or until limit_ns passes. Returns the number of
+// items processed; *timed_out tells which limit ended the run.
+static unsigned int ex2_poll(unsigned int max, u64 limit_ns, bool *timed_out)
+{
+    u64 start = ktime_get_ns();
+    unsigned int done = 0;
+    u32 item;
+
+    *timed_out = false;
+    while (done < max && kfifo_get(&ex2_ring, &item)) {
+        ex2_checksum += item; // The "work"
+        if (work_ns)
+            ndelay(work_ns);
+        done++;
+        // Checking the clock every item would cost more than the items
+        if (!(done & 15) && ktime_get_ns() - start >= limit_ns) {
+            *timed_out = true;
+            break;
+        }
+    }
+    return done;
+}
+
+// Give up ring ownership. Recheck afterwards: an item enqueued just before
+// the clear saw EX2_SCHED set and did not kick anyone.
+static void ex2_complete(void)
+{
+    clear_bit(EX2_SCHED, &ex2_state);
+    smp_mb__after_atomic(); // Pairs with the barrier in ex2_kick()
+    if (!kfifo_is_empty(&ex2_ring) && !READ_ONCE(ex2_stopping) &&
+        !test_and_set_bit(EX2_SCHED, &ex2_state))
+        tasklet_dispatch(&ex2_dispatch, &ex2_req);
+}
+
+// Producer side: make sure some consumer will see the new items
+static void ex2_kick(void)
+{
+    // test_and_set_bit() is fully ordered: the items are visible before
+    // EX2_SCHED is tested, pairing with ex2_complete()
+    if (!test_and_set_bit(EX2_SCHED, &ex2_state)) {
+        EX2_STAT_ADD(kicks, 1);
+        trace_defer_schedule(&ex2_tasklet, kfifo_len(&ex2_ring), false);
+        tasklet_dispatch(&ex2_dispatch, &ex2_req); // Policy picks the CPU
+    }
+}
 
-// Tasklet handler function - reschedules itself!
+// Tasklet handler: one budgeted poll run
 static void ex2_tasklet_handler(unsigned long data)
 {
-    static int count = 0;
-    pr_info("Ex2 Repetitive Tasklet: Handler execution #%d\n", ++count);
+    u64 start = ktime_get_ns(), ns;
+    unsigned int quota = READ_ONCE(budget), done;
+    bool timed_out;
+
+    tasklet_dispatch_ran(&ex2_dispatch, &ex2_req);
+    trace_defer_start(&ex2_tasklet, ex2_stats.runs, false);
+    done = ex2_poll(quota, (u64)READ_ONCE(time_limit_us) * NSEC_PER_USEC, &timed_out);
+    ns = ktime_get_ns() - start;
+    trace_defer_end(&ex2_tasklet, done, false);
 
-    // Reschedule myself for the next run
-    // Check if module is unloading? Not easily done here, rely on kill.
-    if (count < 10) { // Let's limit it for sanity, otherwise it runs forever
-        tasklet_schedule(&ex2_tasklet);
-    } else {
-        pr_info("Ex2 Repetitive Tasklet: Reached limit, stopping rescheduling.\n");
+    EX2_STAT_ADD(runs, 1);
+    EX2_STAT_ADD(items, done);
+    EX2_STAT_ADD(softirq_ns, ns);
+    if (done > ex2_stats.max_items)
+        WRITE_ONCE(ex2_stats.max_items, done);
+    if (ns > ex2_stats.max_run_ns)
+        WRITE_ONCE(ex2_stats.max_run_ns, ns);
+    defer_dbg("Ex2 Poll Tasklet: run processed %u items in %llu ns\n", done, ns);
+
+    if (done < quota && !timed_out) {
+        // Ring drained within budget
+        ex2_exhausted = 0;
+        ex2_complete();
+        return;
     }
+
+    if (timed_out)
+        EX2_STAT_ADD(time_exits, 1);
+    else
+        EX2_STAT_ADD(budget_exits, 1);
+    if (READ_ONCE(ex2_stopping)) {
+        clear_bit(EX2_SCHED, &ex2_state);
+        return;
+    }
+
+    if (++ex2_exhausted >= READ_ONCE(handoff_after)) {
+        // Sustained backlog: keep EX2_SCHED and pass ownership to the thread
+        ex2_exhausted = 0;
+        EX2_STAT_ADD(handoffs, 1);
+        WRITE_ONCE(ex2_threaded, true);
+        wake_up_process(ex2_poll_task);
+        return;
+    }
+
+    // Work remains: reschedule myself for the next run, on this CPU so the
+    // poll loop stays cache-hot; the policy only applies to fresh kicks
+    trace_defer_schedule(&ex2_tasklet, kfifo_len(&ex2_ring), false);
+    tasklet_dispatch_to(&ex2_dispatch, &ex2_req, smp_processor_id());
 }
 
-// Statically declare the tasklet (using DECLARE_TASKLET)
-// We need tasklet_init here because the handler needs the address of the tasklet
-// static DECLARE_TASKLET(ex2_tasklet, ex2_tasklet_handler, 0); // Can't do this easily
+// Drains the ring in process context after a handoff
+static int ex2_poll_thread(void *unused)
+{
+    unsigned int quota, done;
+    bool timed_out;
+
+    while (!kthread_should_stop()) {
+        set_current_state(TASK_INTERRUPTIBLE);
+        if (!READ_ONCE(ex2_threaded)) {
+            schedule();
+            continue;
+        }
+        __set_current_state(TASK_RUNNING);
+
+        quota = READ_ONCE(budget);
+        done = ex2_poll(quota, (u64)READ_ONCE(time_limit_us) * NSEC_PER_USEC, &timed_out);
+        EX2_STAT_ADD(thread_items, done);
+        if (done < quota && !timed_out) {
+            // Backlog gone: hand polling back to the tasklet
+            WRITE_ONCE(ex2_threaded, false);
+            ex2_complete();
+        } else {
+            cond_resched();
+        }
+    }
+    return 0;
+}
+
+static int ex2_producer_thread(void *unused)
+{
+    unsigned int i, n, added;
+    u32 seq = 0;
+
+    while (!kthread_should_stop()) {
+        n = READ_ONCE(burst);
+        if (nr_items)
+            n = min(n, nr_items - seq);
+
+        for (i = 0, added = 0; i < n; i++) {
+            if (kfifo_put(&ex2_ring, seq)) {
+                seq++;
+                added++;
+            } else {
+                EX2_STAT_ADD(dropped, 1);
+            }
+        }
+        EX2_STAT_ADD(produced, added);
+        if (added)
+            ex2_kick();
+
+        if (nr_items && seq >= nr_items) {
+            pr_info("Ex2 Producer: Produced %u items, going idle.\n", seq);
+            // Idle until the module is unloaded
+            while (!kthread_should_stop()) {
+                set_current_state(TASK_INTERRUPTIBLE);
+                if (!kthread_should_stop())
+                    schedule();
+                __set_current_state(TASK_RUNNING);
+            }
+            break;
+        }
+        usleep_range(produce_us, produce_us + produce_us / 4 + 1);
+    }
+    return 0;
+}
+
+// --- Proc File Implementation ---
+
+static int ex2_stats_show(struct seq_file *m, void *v)
+{
+    unsigned long runs = READ_ONCE(ex2_stats.runs);
+    unsigned long items = READ_ONCE(ex2_stats.items);
+
+    seq_printf(m, "--- Ex2 Poll Engine ---\n");
+    seq_printf(m, "Budget: %u items / %u us, handoff after %u exhausted runs\n",
+               READ_ONCE(budget), READ_ONCE(time_limit_us), READ_ONCE(handoff_after));
+    seq_printf(m, "Produced:        %lu (dropped %lu, ring %u/%u)\n",
+               READ_ONCE(ex2_stats.produced), READ_ONCE(ex2_stats.dropped),
+               kfifo_len(&ex2_ring), kfifo_size(&ex2_ring));
+    seq_printf(m, "Kicks:           %lu\n", READ_ONCE(ex2_stats.kicks));
+    seq_printf(m, "Tasklet Runs:    %lu\n", runs);
+    seq_printf(m, "Softirq Items:   %lu (avg %lu/run, max %lu)\n", items,
+               runs ? items / runs : 0, READ_ONCE(ex2_stats.max_items));
+    seq_printf(m, "Budget Exits:    %lu\n", READ_ONCE(ex2_stats.budget_exits));
+    seq_printf(m, "Time Exits:      %lu\n", READ_ONCE(ex2_stats.time_exits));
+    seq_printf(m, "Softirq Time:    %llu ns (max run %llu ns)\n",
+               READ_ONCE(ex2_stats.softirq_ns), READ_ONCE(ex2_stats.max_run_ns));
+    seq_printf(m, "Handoffs:        %lu\n", READ_ONCE(ex2_stats.handoffs));
+    seq_printf(m, "Thread Items:    %lu\n", READ_ONCE(ex2_stats.thread_items));
+    seq_printf(m, "Mode:            %s\n", READ_ONCE(ex2_threaded) ? "thread" : "softirq");
+    tasklet_dispatch_show(m, &ex2_dispatch);
+    return 0;
+}
+
+static int ex2_stats_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, ex2_stats_show, NULL);
+}
+
+static const struct proc_ops ex2_stats_fops = {
+    .proc_open = ex2_stats_open,
+    .proc_read = seq_read,
+    .proc_lseek = seq_lseek,
+    .proc_release = single_release,
+};
 
 static int __init ex2_init(void)
 {
+    int ret;
+
     pr_info("Ex2 Module: Loading...\n");
 
+    if (ring_order < 1 || ring_order > EX2_RING_ORDER_MAX) {
+        pr_err("Ex2: ring_order must be 1-%d.\n", EX2_RING_ORDER_MAX);
+        return -EINVAL;
+    }
+
+    ret = kfifo_alloc(&ex2_ring, 1U << ring_order, GFP_KERNEL);
+    if (ret) {
+        pr_err("Ex2: Failed to allocate producer ring.\n");
+        return ret;
+    }
+
     // Initialize the tasklet dynamically
     tasklet_init(&ex2_tasklet, ex2_tasklet_handler, 0); // Pass 0 as data
+    ret = tasklet_dispatcher_init(&ex2_dispatch);
+    if (ret)
+        goto err_fifo;
 
-    // Schedule the first execution
-    pr_info("Ex2 Module: Scheduling first tasklet run.\n");
-    tasklet_schedule(&ex2_tasklet);
+    ex2_poll_task = kthread_run(ex2_poll_thread, NULL, "ex2_poll");
+    if (IS_ERR(ex2_poll_task)) {
+        ret = PTR_ERR(ex2_poll_task);
+        goto err_dispatch;
+    }
+
+    if (!proc_create(PROC_FILENAME, 0444, NULL, &ex2_stats_fops)) {
+        pr_err("Ex2: Failed to create /proc/%s entry.\n", PROC_FILENAME);
+        ret = -ENOMEM;
+        goto err_poll;
+    }
+
+    // The producer's first burst schedules the first tasklet run
+    pr_info("Ex2 Module: Starting producer.\n");
+    ex2_producer_task = kthread_run(ex2_producer_thread, NULL, "ex2_producer");
+    if (IS_ERR(ex2_producer_task)) {
+        ret = PTR_ERR(ex2_producer_task);
+        goto err_proc;
+    }
 
     return 0; // Success
+
+err_proc:
+    remove_proc_entry(PROC_FILENAME, NULL);
+err_poll:
+    kthread_stop(ex2_poll_task);
+err_dispatch:
+    tasklet_dispatcher_destroy(&ex2_dispatch);
+err_fifo:
+    kfifo_free(&ex2_ring);
+    return ret;
 }
 
 static void __exit ex2_exit(void)
 {
     pr_info("Ex2 Module: Exiting...\n");
 
+    remove_proc_entry(PROC_FILENAME, NULL);
+    kthread_stop(ex2_producer_task);
+
+    // Stop rescheduling and handoffs, then wait for whichever consumer
+    // owns the ring. The tasklet may hand off to the thread until it has
+    // seen ex2_stopping, and the thread may give the ring back to the
+    // tasklet until it has, hence kill, stop, kill.
+    WRITE_ONCE(ex2_stopping, true);
     // CRITICAL: Kill the tasklet. This prevents it from rescheduling
     // after the module code is gone, and waits if it's running.
+    tasklet_dispatcher_sync(&ex2_dispatch);
     tasklet_kill(&ex2_tasklet);
-    pr_info("Ex2 Module: Repetitive tasklet killed.\n");
+    kthread_stop(ex2_poll_task);
+    tasklet_dispatcher_sync(&ex2_dispatch);
+    tasklet_kill(&ex2_tasklet);
+    trace_defer_free(&ex2_tasklet, 0, false);
+    pr_info("Ex2 Module: Poll tasklet killed (%lu items, checksum %u).\n",
+            READ_ONCE(ex2_stats.items) + READ_ONCE(ex2_stats.thread_items), ex2_checksum);
+
+    tasklet_dispatcher_destroy(&ex2_dispatch);
+    kfifo_free(&ex2_ring);
     pr_info("Ex2 Module: Unloaded.\n");
 }
 
@@ -55,5 +395,5 @@ module_exit(ex2_exit);
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Oliver Jędrzejczyk");
-MODULE_DESCRIPTION("Exercise 2: Automatically repetitive tasklet");
-MODULE_VERSION("1.0");
\ No newline at end of file
+MODULE_DESCRIPTION("Exercise 2: Budgeted, self-rescheduling poll tasklet");
+MODULE_VERSION("1.0");
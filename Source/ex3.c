@@ -2,172 +2,1318 @@
 #include <linux/init.h>
 #include <linux/kthread.h>    // kthread_run, kthread_stop
 #include <linux/list.h>       // Linux kernel lists
-#include <linux/slab.h>       // kmalloc, kfree
+#include <linux/slab.h>       // Slab allocator (kmem_cache)
 #include <linux/spinlock.h>   // spin locks
 #include <linux/wait.h>       // wait queues
 #include <linux/sched.h>      // TASK_INTERRUPTIBLE
 #include <linux/delay.h>      // msleep
 #include <linux/printk.h>     // pr_info
+#include <linux/percpu.h>     // DEFINE_PER_CPU, per_cpu_ptr
+#include <linux/cpu.h>        // CPU hotplug states
+#include <linux/cpumask.h>    // cpumask helpers
+#include <linux/proc_fs.h>    // Proc filesystem
+#include <linux/seq_file.h>   // seq_file API for proc
+#include <linux/llist.h>      // Lock-less singly linked lists
+#include <linux/ktime.h>      // ktime_get_ns
+#include <linux/log2.h>       // ilog2
+#include <linux/math64.h>     // div64_u64
+#include <linux/workqueue.h>  // delayed_work for the watchdog
+#include <linux/jiffies.h>    // jiffies, msecs_to_jiffies
+#include "defer_log.h"        // defer_dbg, verbose parameter
+#include "simplewq.h"         // simple_work_t, queue_simple_work
+#include "defer_stats.h"      // defer_hist_percentile
 
-// Structure for our custom work item
-typedef struct {
-    struct list_head list; // Link for the list
-    void (*func)(void *);  // Function to execute
-    void *data;            // Data for the function
-} simple_work_t;
+#define DEFER_TRACE_SYSTEM ex3
+#define CREATE_TRACE_POINTS
+#include "defer_trace.h"      // defer_schedule/start/end/free events
 
-// Global variables for our simple queue
-static LIST_HEAD(work_list);             // Head of the work list
-static DEFINE_SPINLOCK(list_lock);       // Spinlock to protect the list
-static wait_queue_head_t worker_waitqueue; // Wait queue for the worker thread
-static struct task_struct *worker_thread = NULL; // Worker thread task struct
+#define PROC_FILENAME "simplewq_stats"
+#define PROC_WORKERS_FILENAME "simplewq_workers"
+
+// Number of watchdog samples kept for /proc/simplewq_workers
+#define SIMPLE_HISTORY_LEN 64
+
+// Submit-to-execute latency histogram: bucket i counts latencies in
+// [2^i, 2^(i+1)) ns; the last bucket also takes everything above
+#define SIMPLE_LAT_BUCKETS 32
+
+struct simple_pool;
+
+// A worker thread. Every pool has one permanent worker; the watchdog adds
+// spare workers while a running one is blocked inside a work function and
+// reaps them again once they have been idle for idle_timeout_ms.
+struct simple_worker {
+    struct list_head node;         // On pool->workers
+    struct task_struct *task;
+    struct simple_pool *pool;
+    // Detached lock-free batch not yet run. The worker takes items one at
+    // a time with xchg, so a helper can take over the rest with a single
+    // xchg if this worker blocks.
+    struct llist_node *batch;
+    unsigned long progress;        // Items started
+    unsigned long last_progress;   // progress seen by the previous watchdog tick
+    unsigned long idle_since;      // jiffies when it last went idle
+    bool idle;                     // Sleeping on the pool's waitqueue
+    unsigned long state;           // SIMPLE_WORKER_* bits
+    bool spare;                    // Created by the watchdog, may be reaped
+};
+
+// Worker state bits. STALLED is set only by the watchdog, under pool->lock
+// and only while the worker is not idle; whoever flips the bit owns the
+// matching nr_running adjustment, so the two sides can never both drop it.
+#define SIMPLE_WORKER_STALLED 0 // Blocked in a work function
+
+// One pool per CPU: a local queue plus the worker threads bound to that CPU.
+// Producers enqueue on the pool of the CPU they run on, so submissions from
+// different CPUs no longer share a lock or a cache line.
+//
+// Two queues exist per pool. work_list is the original spinlock-protected
+// list. lockless_list is a lock-free stack producers push onto with a single
+// cmpxchg; the worker detaches it whole with one xchg and reverses it to get
+// FIFO order back. Which one submit_work() uses is picked by lockless_submit.
+struct simple_pool {
+    struct list_head work_list;    // Spinlock queue of pending work
+    spinlock_t lock;               // Protects work_list, nr_queued, online
+    unsigned int nr_queued;        // Items on work_list
+    struct llist_head lockless_list; // Lock-free queue of pending work
+    bool online;                   // Pool accepts work (CPU is up)
+    bool kick;                     // Woken to steal or rescue, not for local work
+    atomic_t nr_running;           // Awake, unblocked workers; producers skip
+                                   // wake_up while this is non-zero
+    wait_queue_head_t waitqueue;   // Workers sleep here (exclusive) when idle
+    struct list_head workers;      // struct simple_worker, under lock
+    unsigned int nr_workers;       // Length of workers, under lock
+    unsigned int next_worker_id;   // For thread names, under lock
+    int cpu;
+
+    // Statistics, only written by this pool's workers. They all run on
+    // this CPU, so updates are made with preemption disabled.
+    unsigned long executed;        // Items run by this pool's workers
+    unsigned long stolen;          // Items taken from other CPUs or rescued
+    unsigned long batches;         // Lock-free batches detached
+    unsigned long batched;         // Items run from those batches
+    unsigned long poll_hits;       // Polls that found work before sleeping
+    unsigned long poll_misses;     // Polls that ran out and went to sleep
+    u64 avg_gap_ns;                // EWMA of gaps between queued_ns stamps
+    u64 last_queued_ns;            // queued_ns of the last item run
+    u64 lat_sum_ns;                // Sum of submit-to-execute latencies
+    u64 lat_max_ns;
+    unsigned long lat_hist[SIMPLE_LAT_BUCKETS];
+
+    // Statistics written by the watchdog
+    unsigned long stalls;          // Workers found blocked in a work function
+    unsigned long spawned;         // Spare workers created
+    unsigned long reaped;          // Spare workers stopped after idling
+
+    // Statistics counted on the submitting CPU (this_cpu_inc, no atomics)
+    unsigned long wakeups_issued;  // wake_up() calls made by producers
+    unsigned long wakeups_avoided; // Skipped because the worker was running
+};
+
+static DEFINE_PER_CPU(struct simple_pool, simple_pools);
+static struct kmem_cache *simple_work_cache = NULL; // Backs submit_work() items
+
+DEFINE_DEFER_VERBOSE();
+static struct cpumask simple_idle_mask;   // CPUs whose workers are all sleeping
+static enum cpuhp_state simplewq_hp_state;
+static bool simplewq_exiting;             // Set while the workers are stopped
+static atomic_long_t simple_owned_live;   // simple_work_cache items not yet freed
+
+// Worker count over time, one sample per watchdog tick
+struct simple_sample {
+    unsigned long stamp;           // jiffies
+    unsigned int workers;          // All workers on all CPUs
+    unsigned int running;          // Awake and not blocked
+    unsigned int stalled;          // Blocked in a work function
+};
+
+static struct simple_sample simple_history[SIMPLE_HISTORY_LEN];
+static unsigned int simple_history_next;  // Total samples ever recorded
+static DEFINE_SPINLOCK(simple_history_lock);
+
+static void simplewq_watchdog_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(simplewq_watchdog, simplewq_watchdog_fn);
+
+// A victim must have at least this many queued items before a thief takes any
+static unsigned int steal_threshold = 2;
+module_param(steal_threshold, uint, 0644);
+MODULE_PARM_DESC(steal_threshold, "Minimum backlog on a CPU before idle workers steal from it");
+
+// Submission path: lock-free push (default) or the spinlock-protected list.
+// Both queues are always drained, so this can be flipped at runtime.
+static bool lockless_submit = true;
+module_param(lockless_submit, bool, 0644);
+MODULE_PARM_DESC(lockless_submit, "Submit through the lock-free list instead of the spinlock list");
+
+// Opt-in polling: an idle worker busy-waits for new work for a while before
+// sleeping, so bursty submitters skip the wakeup and context switch. The
+// window follows the recent arrival gap and is capped by poll_max_us.
+static bool poll_mode = false;
+module_param(poll_mode, bool, 0644);
+MODULE_PARM_DESC(poll_mode, "Busy-poll for new work before sleeping");
+
+static unsigned int poll_max_us = 50;
+module_param(poll_max_us, uint, 0644);
+MODULE_PARM_DESC(poll_max_us, "Upper bound of the adaptive polling window in microseconds");
+
+// Concurrency management, modeled on CMWQ: when a worker blocks inside a
+// work function, another worker of the same CPU takes over the rest of the
+// queue. Kernel workqueues learn about blocking from scheduler hooks that
+// modules cannot use, so a watchdog samples the workers instead.
+static unsigned int max_active = 4;
+module_param(max_active, uint, 0644);
+MODULE_PARM_DESC(max_active, "Maximum number of workers per CPU (1 disables spare workers)");
+
+static unsigned int watchdog_ms = 10;
+module_param(watchdog_ms, uint, 0644);
+MODULE_PARM_DESC(watchdog_ms, "Interval of the blocked-worker watchdog in milliseconds");
+
+static unsigned int idle_timeout_ms = 5000;
+module_param(idle_timeout_ms, uint, 0644);
+MODULE_PARM_DESC(idle_timeout_ms, "Idle time after which spare workers are reaped");
 
 // The actual function doing the "work"
 static void simple_do_work(void *data)
 {
-    int id = *(int *)data;
-    pr_info("SimpleWQ: Doing work with data ID: %d\n", id);
-    kfree(data); // Free the data allocated in submit_work
+    int id = *(int *)data; // Points into the item's inline_data
+    defer_dbg("SimpleWQ: Doing work with data ID: %d\n", id);
+}
+
+// Example of a caller-owned request with an embedded work item
+struct simple_demo_req {
+    int id;
+    simple_work_t work;
+};
+
+#define SIMPLE_DEMO_REQS 4
+static struct simple_demo_req simple_demo_reqs[SIMPLE_DEMO_REQS];
+
+static void simple_demo_work(void *data)
+{
+    struct simple_demo_req *req = container_of(data, struct simple_demo_req, work);
+    defer_dbg("SimpleWQ: Doing embedded work with ID: %d\n", req->id);
+}
+
+static bool simple_pool_has_work(struct simple_pool *pool)
+{
+    return READ_ONCE(pool->nr_queued) != 0 || !llist_empty(&pool->lockless_list);
+}
+
+// The worker is not sleeping, i.e. it is draining or about to
+static bool simple_pool_busy(struct simple_pool *pool)
+{
+    return READ_ONCE(pool->online) && atomic_read(&pool->nr_running) > 0;
+}
+
+// Wake a pool's worker after queueing, unless one is known to be running.
+// A worker drops nr_running (a fully ordered atomic) before it re-checks its
+// queues and sleeps; the barrier here pairs with that, so either the worker
+// sees the new item or we see nr_running == 0.
+static void simple_pool_wake(struct simple_pool *pool)
+{
+    smp_mb();
+    if (atomic_read(&pool->nr_running)) {
+        this_cpu_inc(simple_pools.wakeups_avoided);
+        return;
+    }
+    this_cpu_inc(simple_pools.wakeups_issued);
+    wake_up(&pool->waitqueue);
+}
+
+// Turn a detached lock-free chain (newest first) into a FIFO list_head list
+static unsigned int simple_llist_to_list(struct llist_node *batch, struct list_head *out)
+{
+    simple_work_t *work_item, *tmp;
+    unsigned int nr = 0;
+
+    batch = llist_reverse_order(batch);
+    llist_for_each_entry_safe(work_item, tmp, batch, llnode) {
+        list_add_tail(&work_item->list, out);
+        nr++;
+    }
+    return nr;
+}
+
+// Wake one sleeping worker on another CPU so it can steal from 'busy'
+static void simple_kick_idle_worker(struct simple_pool *busy)
+{
+    struct simple_pool *idle;
+    unsigned int cpu;
+
+    cpu = cpumask_any_but(&simple_idle_mask, busy->cpu);
+    if (cpu >= nr_cpu_ids)
+        return;
+
+    idle = per_cpu_ptr(&simple_pools, cpu);
+    WRITE_ONCE(idle->kick, true);
+    this_cpu_inc(simple_pools.wakeups_issued);
+    wake_up(&idle->waitqueue);
+}
+
+// Append a list of 'nr' items to a pool. Fails if the pool's CPU is offline.
+static bool simple_pool_enqueue(struct simple_pool *pool, struct list_head *items,
+                                unsigned int nr)
+{
+    unsigned long flags;
+    unsigned int backlog;
+
+    spin_lock_irqsave(&pool->lock, flags);
+    if (!pool->online) {
+        spin_unlock_irqrestore(&pool->lock, flags);
+        return false;
+    }
+    list_splice_tail_init(items, &pool->work_list);
+    pool->nr_queued += nr;
+    backlog = pool->nr_queued;
+    spin_unlock_irqrestore(&pool->lock, flags);
+
+    // Wake the local worker
+    simple_pool_wake(pool);
+
+    // The local worker is already behind: let an idle CPU help out
+    if (backlog >= steal_threshold)
+        simple_kick_idle_worker(pool);
+
+    return true;
+}
+
+// Lock-free submission of a pre-linked chain (first = newest, last = oldest)
+// with a single cmpxchg on the pool's list head. Only the push that finds
+// the list empty may have to wake the worker; later pushes are picked up by
+// the same drain.
+static void simple_pool_push_batch(struct simple_pool *pool, struct llist_node *first,
+                                   struct llist_node *last)
+{
+    if (llist_add_batch(first, last, &pool->lockless_list)) {
+        simple_pool_wake(pool);
+        return;
+    }
+
+    this_cpu_inc(simple_pools.wakeups_avoided);
+    // Backlog is building up behind a running worker
+    if (simple_pool_busy(pool))
+        simple_kick_idle_worker(pool);
+}
+
+static void simple_pool_push(struct simple_pool *pool, simple_work_t *work)
+{
+    simple_pool_push_batch(pool, &work->llnode, &work->llnode);
+}
+
+// Enqueue on any online pool other than 'skip_cpu' (used as a fallback)
+static bool simple_enqueue_any(struct list_head *items, unsigned int nr, int skip_cpu)
+{
+    int cpu;
+
+    for_each_online_cpu(cpu) {
+        if (cpu == skip_cpu)
+            continue;
+        if (simple_pool_enqueue(per_cpu_ptr(&simple_pools, cpu), items, nr))
+            return true;
+    }
+    return false;
+}
+
+// Move a list of 'nr' stolen items onto this pool's spinlock queue
+static void simple_pool_take(struct simple_pool *pool, struct list_head *stolen,
+                             unsigned int nr)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&pool->lock, flags);
+    list_splice_tail(stolen, &pool->work_list);
+    pool->nr_queued += nr;
+    spin_unlock_irqrestore(&pool->lock, flags);
+
+    preempt_disable();
+    pool->stolen += nr;
+    preempt_enable();
+}
+
+// Take the pending lock-free batch of a CPU whose worker is busy. Offline
+// pools are included so pushes that raced with CPU removal are not stranded.
+static bool simple_steal_lockless(struct simple_pool *pool)
+{
+    struct llist_node *batch;
+    struct simple_pool *p;
+    unsigned int nr;
+    LIST_HEAD(stolen);
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        p = per_cpu_ptr(&simple_pools, cpu);
+        if (p == pool || llist_empty(&p->lockless_list))
+            continue;
+        if (READ_ONCE(p->online) && !simple_pool_busy(p))
+            continue; // Its own worker is about to run it
+        batch = llist_del_all(&p->lockless_list);
+        if (!batch)
+            continue;
+        nr = simple_llist_to_list(batch, &stolen);
+        simple_pool_take(pool, &stolen, nr);
+        return true;
+    }
+    return false;
 }
 
-// Worker thread function
+// Take over the unfinished batch of a sibling worker that the watchdog
+// found blocked. The chain goes into our own batch slot, so it can be
+// rescued again if we block as well.
+static bool simple_rescue_stalled(struct simple_worker *self)
+{
+    struct simple_pool *pool = self->pool;
+    struct llist_node *batch = NULL;
+    struct simple_worker *w;
+    unsigned long flags;
+
+    spin_lock_irqsave(&pool->lock, flags);
+    list_for_each_entry(w, &pool->workers, node) {
+        if (w == self || !test_bit(SIMPLE_WORKER_STALLED, &w->state) ||
+            !READ_ONCE(w->batch))
+            continue;
+        batch = xchg(&w->batch, NULL);
+        if (batch)
+            break;
+    }
+    spin_unlock_irqrestore(&pool->lock, flags);
+
+    if (!batch)
+        return false;
+
+    smp_store_release(&self->batch, batch);
+    preempt_disable();
+    pool->stolen++;
+    preempt_enable();
+    return true;
+}
+
+// Take over a blocked sibling's batch, or else roughly half of the backlog
+// of the busiest other CPU. Returns true if there is now work to run.
+static bool simple_steal_work(struct simple_worker *self)
+{
+    struct simple_pool *pool = self->pool;
+    struct simple_pool *victim = NULL, *p;
+    struct list_head *cut;
+    unsigned int best = 0, nr, i;
+    unsigned long flags;
+    LIST_HEAD(stolen);
+    int cpu;
+
+    if (simple_rescue_stalled(self))
+        return true;
+
+    if (simple_steal_lockless(pool))
+        return true;
+
+    // Pick a victim without locking; the count is only a hint
+    for_each_online_cpu(cpu) {
+        p = per_cpu_ptr(&simple_pools, cpu);
+        if (p == pool)
+            continue;
+        nr = READ_ONCE(p->nr_queued);
+        if (nr >= steal_threshold && nr > best) {
+            best = nr;
+            victim = p;
+        }
+    }
+    if (!victim)
+        return false;
+
+    spin_lock_irqsave(&victim->lock, flags);
+    nr = (victim->nr_queued + 1) / 2;
+    if (nr == 0 || victim->nr_queued < steal_threshold) {
+        spin_unlock_irqrestore(&victim->lock, flags);
+        return false;
+    }
+    // Detach the oldest 'nr' items so they keep their relative order
+    cut = victim->work_list.next;
+    for (i = 1; i < nr; i++)
+        cut = cut->next;
+    list_cut_position(&stolen, &victim->work_list, cut);
+    victim->nr_queued -= nr;
+    spin_unlock_irqrestore(&victim->lock, flags);
+
+    simple_pool_take(pool, &stolen, nr);
+    return true;
+}
+
+// Account one item's latency and the gap since the previous arrival.
+// Only the pool's own workers call this, with preemption disabled.
+static void simple_account_latency(struct simple_pool *pool, u64 queued_ns)
+{
+    u64 now = ktime_get_ns();
+    u64 lat = now > queued_ns ? now - queued_ns : 0;
+    u64 gap;
+
+    pool->lat_hist[lat ? min_t(int, ilog2(lat), SIMPLE_LAT_BUCKETS - 1) : 0]++;
+    pool->lat_sum_ns += lat;
+    if (lat > pool->lat_max_ns)
+        pool->lat_max_ns = lat;
+
+    // Stolen items can be older than the last one run; ignore those gaps
+    if (queued_ns > pool->last_queued_ns) {
+        gap = queued_ns - pool->last_queued_ns;
+        if (pool->last_queued_ns)
+            pool->avg_gap_ns = pool->avg_gap_ns ?
+                               (pool->avg_gap_ns * 7 + gap) / 8 : gap;
+        pool->last_queued_ns = queued_ns;
+    }
+}
+
+// Polling window for this pool in ns: twice the average arrival gap, so a
+// burst's next item is usually caught, or none if items arrive too rarely
+// for polling to pay off.
+static u64 simple_poll_window(struct simple_pool *pool)
+{
+    u64 max_ns = (u64)READ_ONCE(poll_max_us) * NSEC_PER_USEC;
+    u64 gap = pool->avg_gap_ns;
+
+    if (!READ_ONCE(poll_mode) || !max_ns)
+        return 0;
+    if (!gap)
+        return max_ns; // No history yet
+    if (gap > max_ns)
+        return 0;
+    return min(gap * 2, max_ns);
+}
+
+// Spin until work shows up or the window closes. nr_running stays raised
+// the whole time, so producers do not issue wakeups while we poll. Only the
+// permanent worker polls, so the counters need no protection.
+static bool simple_poll_for_work(struct simple_pool *pool)
+{
+    u64 window = simple_poll_window(pool);
+    u64 deadline;
+
+    if (!window)
+        return false;
+
+    deadline = ktime_get_ns() + window;
+    do {
+        if (simple_pool_has_work(pool)) {
+            pool->poll_hits++;
+            return true;
+        }
+        if (need_resched() || kthread_should_stop())
+            break;
+        cpu_relax();
+    } while (ktime_get_ns() < deadline);
+
+    pool->poll_misses++;
+    return false;
+}
+
+// Back from a work function the watchdog flagged as blocked: take back
+// the nr_running share it dropped
+static void simple_worker_unstall(struct simple_worker *worker)
+{
+    if (test_and_clear_bit(SIMPLE_WORKER_STALLED, &worker->state))
+        atomic_inc(&worker->pool->nr_running);
+}
+
+static void simple_run_work(struct simple_worker *worker, simple_work_t *work_item)
+{
+    struct simple_pool *pool = worker->pool;
+    void (*func)(void *) = work_item->func;
+    void *data = work_item->data;
+
+    preempt_disable();
+    simple_account_latency(pool, work_item->queued_ns);
+    preempt_enable();
+    WRITE_ONCE(worker->progress, worker->progress + 1);
+
+    // Free the work item structure once it has run
+    if (test_bit(SIMPLE_WORK_OWNED, &work_item->flags)) {
+        trace_defer_start(work_item, 0, false);
+        defer_dbg("SimpleWQ: Worker %d executing function %pS\n", pool->cpu, func);
+        func(data);
+        trace_defer_end(work_item, 0, false);
+        trace_defer_free(work_item, 0, false);
+        kmem_cache_free(simple_work_cache, work_item);
+        atomic_long_dec(&simple_owned_live);
+    } else {
+        // An embedded item belongs to the caller, who may requeue or free
+        // it from func: release it first and never touch it afterwards
+        // (the end event only records the pointer value).
+        smp_mb__before_atomic();
+        clear_bit(SIMPLE_WORK_PENDING, &work_item->flags);
+        trace_defer_start(work_item, 0, false);
+        defer_dbg("SimpleWQ: Worker %d executing function %pS\n", pool->cpu, func);
+        func(data);
+        trace_defer_end(work_item, 0, false);
+    }
+
+    // The watchdog may still flag us after this check; then the next item
+    // or simple_worker_sleep() clears it
+    if (unlikely(test_bit(SIMPLE_WORKER_STALLED, &worker->state)))
+        simple_worker_unstall(worker);
+
+    preempt_disable();
+    pool->executed++;
+    preempt_enable();
+}
+
+// Take the next item of the worker's detached batch. The xchg hands us the
+// whole chain, so reading the next pointer is safe; the remainder is then
+// published again for a possible rescuer.
+static simple_work_t *simple_worker_next(struct simple_worker *worker)
+{
+    struct llist_node *node;
+
+    node = xchg(&worker->batch, NULL);
+    if (!node)
+        return NULL;
+    smp_store_release(&worker->batch, node->next);
+    return llist_entry(node, simple_work_t, llnode);
+}
+
+// Run whatever is left in the worker's batch slot
+static unsigned int simple_run_batch(struct simple_worker *worker)
+{
+    simple_work_t *work_item;
+    unsigned int nr = 0;
+
+    while ((work_item = simple_worker_next(worker))) {
+        simple_run_work(worker, work_item);
+        nr++;
+    }
+    return nr;
+}
+
+// Detach everything pushed onto the lock-free list and run it in FIFO order
+// without taking any lock. Returns the number of items run.
+static unsigned int simple_drain_lockless(struct simple_worker *worker)
+{
+    struct simple_pool *pool = worker->pool;
+    struct llist_node *batch;
+    unsigned int nr;
+
+    batch = llist_del_all(&pool->lockless_list);
+    if (!batch)
+        return 0;
+
+    smp_store_release(&worker->batch, llist_reverse_order(batch));
+    nr = simple_run_batch(worker);
+
+    preempt_disable();
+    pool->batches++;
+    pool->batched += nr;
+    preempt_enable();
+    return nr;
+}
+
+// Sleep until there's work, a steal/rescue request or we should stop
+static void simple_worker_sleep(struct simple_worker *worker)
+{
+    struct simple_pool *pool = worker->pool;
+    unsigned long flags;
+
+    // Going idle under pool->lock closes the window in which the watchdog
+    // could flag us after the last unstall check: from here on it skips us
+    spin_lock_irqsave(&pool->lock, flags);
+    worker->idle_since = jiffies;
+    WRITE_ONCE(worker->idle, true);
+    spin_unlock_irqrestore(&pool->lock, flags);
+    simple_worker_unstall(worker);
+
+    // From here on producers must wake us (see simple_pool_wake). The
+    // value-returning atomic is fully ordered against the checks below.
+    if (atomic_dec_and_test(&pool->nr_running))
+        cpumask_set_cpu(pool->cpu, &simple_idle_mask);
+
+    // Exclusive: one wake_up() wakes one worker of this pool
+    wait_event_interruptible_exclusive(pool->waitqueue,
+                                       simple_pool_has_work(pool) ||
+                                       READ_ONCE(pool->kick) ||
+                                       kthread_should_stop());
+
+    if (atomic_inc_return(&pool->nr_running) == 1)
+        cpumask_clear_cpu(pool->cpu, &simple_idle_mask);
+    WRITE_ONCE(worker->idle, false);
+    WRITE_ONCE(pool->kick, false);
+}
+
+// Per-CPU worker thread function
 static int worker_thread_fn(void *data)
 {
+    struct simple_worker *worker = data;
+    struct simple_pool *pool = worker->pool;
     simple_work_t *work_item;
     unsigned long flags;
 
-    pr_info("SimpleWQ: Worker thread started.\n");
+    pr_info("SimpleWQ: Worker thread started on CPU %d.\n", pool->cpu);
 
     while (!kthread_should_stop()) {
-        // Wait until there's work or we should stop
-        wait_event_interruptible(worker_waitqueue,
-                                 !list_empty(&work_list) || kthread_should_stop());
-
-        if (kthread_should_stop()) {
-            pr_info("SimpleWQ: Worker thread received stop signal.\n");
-            break;
+        // Nothing local to do: try to help before sleeping
+        if (!simple_pool_has_work(pool) && !simple_steal_work(worker) &&
+            (worker->spare || !simple_poll_for_work(pool))) {
+            simple_worker_sleep(worker);
+            continue; // Re-check stop, local work and steal in order
         }
 
-        // Process all items currently in the list
+        // Finish a rescued batch first
+        simple_run_batch(worker);
+
+        // Process all items currently in the spinlock list
         while (1) {
-            spin_lock_irqsave(&list_lock, flags);
-            if (list_empty(&work_list)) {
-                spin_unlock_irqrestore(&list_lock, flags);
+            spin_lock_irqsave(&pool->lock, flags);
+            if (list_empty(&pool->work_list)) {
+                spin_unlock_irqrestore(&pool->lock, flags);
                 break; // No more work for now
             }
             // Get the first work item
-            work_item = list_first_entry(&work_list, simple_work_t, list);
+            work_item = list_first_entry(&pool->work_list, simple_work_t, list);
             list_del(&work_item->list); // Remove from list
-            spin_unlock_irqrestore(&list_lock, flags);
-
-            // Execute the work function
-            pr_info("SimpleWQ: Worker executing function %pS\n", work_item->func);
-            work_item->func(work_item->data);
+            pool->nr_queued--;
+            spin_unlock_irqrestore(&pool->lock, flags);
 
-            // Free the work item structure
-            kfree(work_item);
+            simple_run_work(worker, work_item);
             work_item = NULL; // Good practice
         }
-        // Yield just in case, though wait_event usually handles scheduling
-        // schedule(); // Not strictly necessary here
+
+        // Then everything pushed lock-free, one batch at a time
+        while (simple_drain_lockless(worker))
+            ;
     }
 
-    pr_info("SimpleWQ: Worker thread stopping.\n");
+    // An exclusive wakeup meant for work may have picked us; pass it on.
+    // We are off pool->workers by now, so the watchdog cannot flag us.
+    if (!test_and_clear_bit(SIMPLE_WORKER_STALLED, &worker->state))
+        atomic_dec(&pool->nr_running);
+    if (simple_pool_has_work(pool))
+        wake_up(&pool->waitqueue);
+
+    pr_info("SimpleWQ: Worker thread on CPU %d stopping.\n", pool->cpu);
     return 0;
 }
 
-// Function to submit work to our simple queue
-static int submit_work(void (*func)(void *), int id)
+// Put a prepared item on the local CPU's queue
+static int simple_queue(simple_work_t *work)
+{
+    LIST_HEAD(items);
+    int cpu;
+
+    work->queued_ns = ktime_get_ns();
+    trace_defer_schedule(work, 0, false);
+
+    // Queue on the local CPU. Being migrated right after reading the CPU
+    // number is harmless: the item just lands on a neighbour's queue.
+    cpu = raw_smp_processor_id();
+    if (READ_ONCE(lockless_submit)) {
+        // A push racing with CPU removal is picked up by stealing
+        simple_pool_push(per_cpu_ptr(&simple_pools, cpu), work);
+        return 0;
+    }
+
+    INIT_LIST_HEAD(&work->list);
+    list_add_tail(&work->list, &items);
+    if (!simple_pool_enqueue(per_cpu_ptr(&simple_pools, cpu), &items, 1) &&
+        !simple_enqueue_any(&items, 1, cpu))
+        return -ENODEV;
+
+    return 0;
+}
+
+// Queue a caller-owned (embedded) work item. Nothing is allocated.
+// Returns false if the item is already pending.
+bool queue_simple_work(simple_work_t *work)
+{
+    if (test_and_set_bit(SIMPLE_WORK_PENDING, &work->flags))
+        return false;
+
+    if (simple_queue(work)) {
+        clear_bit(SIMPLE_WORK_PENDING, &work->flags);
+        return false;
+    }
+    return true;
+}
+EXPORT_SYMBOL_GPL(queue_simple_work);
+
+// Queue up to 'nr' caller-prepared items in one go: one critical section
+// (or one cmpxchg in lock-free mode) and at most one wakeup for the batch.
+// Items that are already pending are skipped. Returns the number queued.
+static unsigned int submit_work_batch(simple_work_t **works, unsigned int nr)
+{
+    struct llist_node *first = NULL, *last = NULL;
+    simple_work_t *work_item, *tmp;
+    struct simple_pool *pool;
+    unsigned int i, queued = 0;
+    u64 now = ktime_get_ns();
+    LIST_HEAD(items);
+    int cpu;
+
+    if (READ_ONCE(lockless_submit)) {
+        // Link newest-first so the worker's reversal restores array order
+        for (i = 0; i < nr; i++) {
+            if (test_and_set_bit(SIMPLE_WORK_PENDING, &works[i]->flags))
+                continue;
+            works[i]->queued_ns = now;
+            trace_defer_schedule(works[i], 0, false);
+            works[i]->llnode.next = first;
+            first = &works[i]->llnode;
+            if (!last)
+                last = first;
+            queued++;
+        }
+        if (queued)
+            simple_pool_push_batch(raw_cpu_ptr(&simple_pools), first, last);
+        return queued;
+    }
+
+    for (i = 0; i < nr; i++) {
+        if (test_and_set_bit(SIMPLE_WORK_PENDING, &works[i]->flags))
+            continue;
+        works[i]->queued_ns = now;
+        trace_defer_schedule(works[i], 0, false);
+        list_add_tail(&works[i]->list, &items);
+        queued++;
+    }
+    if (!queued)
+        return 0;
+
+    cpu = raw_smp_processor_id();
+    pool = per_cpu_ptr(&simple_pools, cpu);
+    if (!simple_pool_enqueue(pool, &items, queued) &&
+        !simple_enqueue_any(&items, queued, cpu)) {
+        // Nothing is online; hand the items back unqueued
+        list_for_each_entry_safe(work_item, tmp, &items, list) {
+            list_del(&work_item->list);
+            clear_bit(SIMPLE_WORK_PENDING, &work_item->flags);
+        }
+        return 0;
+    }
+    return queued;
+}
+
+// Submit a function with a small payload copied into the work item.
+// Costs one allocation from simple_work_cache and no separate data buffer.
+static int submit_work_inline(void (*func)(void *), const void *payload, size_t len)
 {
     simple_work_t *new_work;
-    int *data_copy;
-    unsigned long flags;
+    int ret;
 
-    // Allocate memory for the work item
-    new_work = kmalloc(sizeof(simple_work_t), GFP_KERNEL);
+    if (len > SIMPLE_WORK_INLINE_SIZE)
+        return -E2BIG;
+
+    // Allocate the work item from our dedicated cache
+    new_work = kmem_cache_alloc(simple_work_cache, GFP_KERNEL);
     if (!new_work) {
         pr_err("SimpleWQ: Failed to allocate memory for work item\n");
         return -ENOMEM;
     }
+    atomic_long_inc(&simple_owned_live);
+
+    // Initialize the work item
+    memcpy(new_work->inline_data, payload, len);
+    new_work->func = func;
+    new_work->data = new_work->inline_data;
+    new_work->flags = BIT(SIMPLE_WORK_OWNED) | BIT(SIMPLE_WORK_PENDING);
+
+    ret = simple_queue(new_work);
+    if (ret) {
+        kmem_cache_free(simple_work_cache, new_work);
+        atomic_long_dec(&simple_owned_live);
+    }
+    return ret;
+}
 
-    // Allocate memory for the data (just an int here)
-    data_copy = kmalloc(sizeof(int), GFP_KERNEL);
-    if (!data_copy) {
-        kfree(new_work);
-        pr_err("SimpleWQ: Failed to allocate memory for work data\n");
+// Function to submit work to our simple queue
+static int submit_work(void (*func)(void *), int id)
+{
+    int ret;
+
+    ret = submit_work_inline(func, &id, sizeof(id));
+    if (ret) {
+        pr_err("SimpleWQ: Failed to submit work ID %d (%d)\n", id, ret);
+        return ret;
+    }
+
+    defer_dbg("SimpleWQ: Submitted work with ID %d\n", id);
+    return 0;
+}
+
+// --- Worker Management ---
+
+// Create a worker bound to the pool's CPU and add it to the pool
+static int simple_create_worker(struct simple_pool *pool, bool spare)
+{
+    struct simple_worker *worker;
+    struct task_struct *task;
+    unsigned int id;
+
+    worker = kzalloc(sizeof(*worker), GFP_KERNEL);
+    if (!worker)
         return -ENOMEM;
+    worker->pool = pool;
+    worker->spare = spare;
+
+    spin_lock_irq(&pool->lock);
+    id = pool->next_worker_id++;
+    spin_unlock_irq(&pool->lock);
+
+    task = kthread_create_on_node(worker_thread_fn, worker, cpu_to_node(pool->cpu),
+                                  "simple_worker/%d:%u", pool->cpu, id);
+    if (IS_ERR(task)) {
+        pr_err("SimpleWQ: Failed to create worker for CPU %d (%ld)\n",
+               pool->cpu, PTR_ERR(task));
+        kfree(worker);
+        return PTR_ERR(task);
     }
-    *data_copy = id;
+    kthread_bind(task, pool->cpu);
+    worker->task = task;
 
-    // Initialize the work item
-    INIT_LIST_HEAD(&new_work->list);
-    new_work->func = func;
-    new_work->data = data_copy;
+    spin_lock_irq(&pool->lock);
+    list_add_tail(&worker->node, &pool->workers);
+    pool->nr_workers++;
+    if (spare)
+        pool->spawned++;
+    spin_unlock_irq(&pool->lock);
+
+    atomic_inc(&pool->nr_running); // Dropped again when it first goes idle
+    wake_up_process(task);
+    return 0;
+}
+
+// Stop and free a list of workers already removed from their pool
+static void simple_destroy_workers(struct list_head *workers)
+{
+    struct simple_worker *worker, *tmp;
+
+    list_for_each_entry_safe(worker, tmp, workers, node) {
+        list_del(&worker->node);
+        kthread_stop(worker->task);
+        kfree(worker);
+    }
+}
+
+static void simple_record_sample(unsigned int workers, unsigned int running,
+                                 unsigned int stalled)
+{
+    struct simple_sample *sample;
+
+    spin_lock_bh(&simple_history_lock);
+    sample = &simple_history[simple_history_next++ % SIMPLE_HISTORY_LEN];
+    sample->stamp = jiffies;
+    sample->workers = workers;
+    sample->running = running;
+    sample->stalled = stalled;
+    spin_unlock_bh(&simple_history_lock);
+}
+
+// Watchdog: flag workers that have been blocked in a work function since
+// the previous tick, get another worker going on their CPU, and reap spare
+// workers that have idled for idle_timeout_ms.
+static void simplewq_watchdog_fn(struct work_struct *work)
+{
+    unsigned int workers = 0, running = 0, stalled = 0;
+    unsigned int nr_idle, nr_stalled, nr_workers;
+    unsigned long idle_timeout = msecs_to_jiffies(idle_timeout_ms);
+    struct simple_worker *w, *tmp;
+    struct simple_pool *pool;
+    unsigned long progress;
+    bool rescue;
+    LIST_HEAD(reap);
+    int cpu;
+
+    cpus_read_lock(); // Keep the hotplug callbacks out while we look around
+    for_each_online_cpu(cpu) {
+        pool = per_cpu_ptr(&simple_pools, cpu);
+        nr_idle = 0;
+        nr_stalled = 0;
+        rescue = false;
+
+        spin_lock_irq(&pool->lock);
+        if (!pool->online) {
+            spin_unlock_irq(&pool->lock);
+            continue;
+        }
+        list_for_each_entry_safe(w, tmp, &pool->workers, node) {
+            if (READ_ONCE(w->idle)) {
+                if (w->spare && time_after(jiffies, w->idle_since + idle_timeout)) {
+                    list_move(&w->node, &reap);
+                    pool->nr_workers--;
+                    pool->reaped++;
+                } else {
+                    nr_idle++;
+                }
+                continue;
+            }
+            // Awake, made no progress for a whole tick and not runnable:
+            // it is sleeping inside a work function
+            progress = READ_ONCE(w->progress);
+            if (progress == w->last_progress && !task_is_running(w->task) &&
+                !test_and_set_bit(SIMPLE_WORKER_STALLED, &w->state)) {
+                atomic_dec(&pool->nr_running);
+                pool->stalls++;
+            }
+            w->last_progress = progress;
+            if (test_bit(SIMPLE_WORKER_STALLED, &w->state)) {
+                nr_stalled++;
+                if (READ_ONCE(w->batch))
+                    rescue = true;
+            }
+        }
+        nr_workers = pool->nr_workers;
+        spin_unlock_irq(&pool->lock);
+
+        if (nr_stalled) {
+            if (nr_idle && (rescue || simple_pool_has_work(pool))) {
+                // An idle worker can take over right away
+                WRITE_ONCE(pool->kick, true);
+                wake_up(&pool->waitqueue);
+            } else if (!nr_idle && nr_workers < READ_ONCE(max_active)) {
+                // Keep one worker ready for the queue behind the blocked one
+                if (!simple_create_worker(pool, true))
+                    nr_workers++;
+            }
+        }
+
+        workers += nr_workers;
+        running += atomic_read(&pool->nr_running);
+        stalled += nr_stalled;
+    }
+    cpus_read_unlock();
+
+    simple_destroy_workers(&reap);
+    simple_record_sample(workers, running, stalled);
+
+    if (!READ_ONCE(simplewq_exiting))
+        schedule_delayed_work(&simplewq_watchdog, msecs_to_jiffies(max(watchdog_ms, 1U)));
+}
+
+// --- CPU Hotplug ---
+
+static int simplewq_cpu_online(unsigned int cpu)
+{
+    struct simple_pool *pool = per_cpu_ptr(&simple_pools, cpu);
+    int ret;
+
+    ret = simple_create_worker(pool, false);
+    if (ret)
+        return ret;
+
+    spin_lock_irq(&pool->lock);
+    pool->online = true;
+    spin_unlock_irq(&pool->lock);
+    return 0;
+}
+
+static int simplewq_cpu_offline(unsigned int cpu)
+{
+    struct simple_pool *pool = per_cpu_ptr(&simple_pools, cpu);
+    unsigned int nr;
+    LIST_HEAD(workers);
+    LIST_HEAD(orphans);
+
+    // Stop accepting new work, then stop all workers. Each one finishes
+    // the batch it holds before it sees the stop request.
+    spin_lock_irq(&pool->lock);
+    pool->online = false;
+    list_splice_init(&pool->workers, &workers);
+    pool->nr_workers = 0;
+    spin_unlock_irq(&pool->lock);
+
+    simple_destroy_workers(&workers);
+    cpumask_clear_cpu(cpu, &simple_idle_mask);
+
+    // Hand whatever is still queued to a CPU that stays online.
+    // During module unload the items stay put and ex3_exit frees them.
+    if (simplewq_exiting)
+        return 0;
+
+    spin_lock_irq(&pool->lock);
+    list_splice_init(&pool->work_list, &orphans);
+    nr = pool->nr_queued;
+    pool->nr_queued = 0;
+    spin_unlock_irq(&pool->lock);
+    nr += simple_llist_to_list(llist_del_all(&pool->lockless_list), &orphans);
+
+    if (nr && !simple_enqueue_any(&orphans, nr, cpu)) {
+        // No other pool is online; keep the items for the next online
+        spin_lock_irq(&pool->lock);
+        list_splice(&orphans, &pool->work_list);
+        pool->nr_queued += nr;
+        spin_unlock_irq(&pool->lock);
+    }
+    return 0;
+}
+
+// --- Proc File Implementation ---
+
+static int simplewq_stats_show(struct seq_file *m, void *v)
+{
+    unsigned long executed = 0, stolen = 0, batches = 0, batched = 0;
+    unsigned long wakeups_issued = 0, wakeups_avoided = 0;
+    unsigned long poll_hits = 0, poll_misses = 0, lat_count = 0;
+    unsigned long stalls = 0, spawned = 0, reaped = 0;
+    unsigned long hist[SIMPLE_LAT_BUCKETS] = { 0 };
+    unsigned int queued = 0, workers = 0;
+    u64 lat_sum = 0, lat_max = 0;
+    struct simple_pool *pool;
+    int cpu, i;
+
+    seq_printf(m, "--- SimpleWQ Statistics ---\n");
+    for_each_possible_cpu(cpu) {
+        pool = per_cpu_ptr(&simple_pools, cpu);
+        queued += READ_ONCE(pool->nr_queued);
+        executed += READ_ONCE(pool->executed);
+        stolen += READ_ONCE(pool->stolen);
+        batches += READ_ONCE(pool->batches);
+        batched += READ_ONCE(pool->batched);
+        wakeups_issued += READ_ONCE(pool->wakeups_issued);
+        wakeups_avoided += READ_ONCE(pool->wakeups_avoided);
+        poll_hits += READ_ONCE(pool->poll_hits);
+        poll_misses += READ_ONCE(pool->poll_misses);
+        lat_sum += READ_ONCE(pool->lat_sum_ns);
+        lat_max = max(lat_max, READ_ONCE(pool->lat_max_ns));
+        for (i = 0; i < SIMPLE_LAT_BUCKETS; i++)
+            hist[i] += READ_ONCE(pool->lat_hist[i]);
+        workers += READ_ONCE(pool->nr_workers);
+        stalls += READ_ONCE(pool->stalls);
+        spawned += READ_ONCE(pool->spawned);
+        reaped += READ_ONCE(pool->reaped);
+    }
+    for (i = 0; i < SIMPLE_LAT_BUCKETS; i++)
+        lat_count += hist[i];
+    seq_printf(m, "Submit mode: %s\n", READ_ONCE(lockless_submit) ? "lock-free" : "spinlock");
+    seq_printf(m, "Queued (spinlock list): %u\n", queued);
+    seq_printf(m, "Allocated items live: %ld\n", atomic_long_read(&simple_owned_live));
+    seq_printf(m, "Executed: %lu\n", executed);
+    seq_printf(m, "Stolen:   %lu\n", stolen);
+    seq_printf(m, "Lock-free batches: %lu (avg %lu items)\n", batches,
+               batches ? batched / batches : 0);
+    seq_printf(m, "Wakeups issued:  %lu\n", wakeups_issued);
+    seq_printf(m, "Wakeups avoided: %lu\n", wakeups_avoided);
+    seq_printf(m, "Poll mode: %s (max %u us), hits %lu misses %lu\n",
+               READ_ONCE(poll_mode) ? "on" : "off", READ_ONCE(poll_max_us),
+               poll_hits, poll_misses);
+    seq_printf(m, "Latency (submit->execute, ns): avg %llu p50 <%llu p99 <%llu max %llu\n",
+               lat_count ? div64_u64(lat_sum, lat_count) : 0,
+               defer_hist_percentile(hist, SIMPLE_LAT_BUCKETS, lat_count, 5000),
+               defer_hist_percentile(hist, SIMPLE_LAT_BUCKETS, lat_count, 9900), lat_max);
+    seq_printf(m, "Workers: %u (max_active %u per CPU)\n", workers, READ_ONCE(max_active));
+    seq_printf(m, "Blocked workers detected: %lu, spares spawned %lu, reaped %lu\n",
+               stalls, spawned, reaped);
 
-    // Add to the list (protected by spinlock)
-    spin_lock_irqsave(&list_lock, flags);
-    list_add_tail(&new_work->list, &work_list);
-    spin_unlock_irqrestore(&list_lock, flags);
+    for_each_possible_cpu(cpu) {
+        pool = per_cpu_ptr(&simple_pools, cpu);
+        seq_printf(m, "cpu%-3d %s workers %u running %d queued %u executed %lu stolen %lu batches %lu gap %llu ns\n",
+                   cpu, READ_ONCE(pool->online) ? "online " : "offline",
+                   READ_ONCE(pool->nr_workers), atomic_read(&pool->nr_running),
+                   READ_ONCE(pool->nr_queued), READ_ONCE(pool->executed),
+                   READ_ONCE(pool->stolen), READ_ONCE(pool->batches),
+                   READ_ONCE(pool->avg_gap_ns));
+    }
+    return 0;
+}
 
-    // Wake up the worker thread
-    wake_up(&worker_waitqueue);
+// Worker count history, oldest sample first
+static int simplewq_workers_show(struct seq_file *m, void *v)
+{
+    struct simple_sample *sample;
+    unsigned int next, nr, i;
+    unsigned long now = jiffies;
 
-    pr_info("SimpleWQ: Submitted work with ID %d\n", id);
+    seq_printf(m, "# age_ms workers running stalled\n");
+    spin_lock_bh(&simple_history_lock);
+    next = simple_history_next;
+    nr = min_t(unsigned int, next, SIMPLE_HISTORY_LEN);
+    for (i = next - nr; i != next; i++) {
+        sample = &simple_history[i % SIMPLE_HISTORY_LEN];
+        seq_printf(m, "%u %u %u %u\n", jiffies_to_msecs(now - sample->stamp),
+                   sample->workers, sample->running, sample->stalled);
+    }
+    spin_unlock_bh(&simple_history_lock);
     return 0;
 }
 
+// Boilerplate for single proc file read
+static int simplewq_stats_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, simplewq_stats_show, NULL);
+}
+
+static const struct proc_ops simplewq_stats_fops = {
+    .proc_open = simplewq_stats_open,
+    .proc_read = seq_read,
+    .proc_lseek = seq_lseek,
+    .proc_release = single_release,
+};
+
+static int simplewq_workers_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, simplewq_workers_show, NULL);
+}
+
+static const struct proc_ops simplewq_workers_fops = {
+    .proc_open = simplewq_workers_open,
+    .proc_read = seq_read,
+    .proc_lseek = seq_lseek,
+    .proc_release = single_release,
+};
+
+// --- Engine Start/Stop ---
+//
+// Workers and watchdog, separate from the pools and item cache (set up
+// once by ex3_init) so the KUnit suite can stop the engine with items
+// still queued and start it again.
+
+// One worker per online CPU, following CPUs going up and down, plus the
+// watchdog
+static int simplewq_start(void)
+{
+    int ret;
+
+    WRITE_ONCE(simplewq_exiting, false);
+    ret = cpuhp_setup_state(CPUHP_AP_ONLINE_DYN, "simplewq:online",
+                            simplewq_cpu_online, simplewq_cpu_offline);
+    if (ret < 0) {
+        pr_err("SimpleWQ: Failed to register CPU hotplug state (%d)\n", ret);
+        return ret;
+    }
+    simplewq_hp_state = ret;
+
+    // Start watching for workers blocked in work functions
+    schedule_delayed_work(&simplewq_watchdog, msecs_to_jiffies(max(watchdog_ms, 1U)));
+    return 0;
+}
+
+// Stop the watchdog and every worker. Queued items stay where they are
+// until simplewq_discard_queued() or the next simplewq_start().
+static void simplewq_stop(void)
+{
+    // Stop the watchdog first so it cannot spawn workers behind our back
+    WRITE_ONCE(simplewq_exiting, true);
+    cancel_delayed_work_sync(&simplewq_watchdog);
+
+    // Stop all worker threads (runs the offline callback on every CPU)
+    cpuhp_remove_state(simplewq_hp_state);
+}
+
+// Drop everything still queued while the engine is stopped: free items
+// from simple_work_cache and release embedded ones without running them.
+// Returns the number of items dropped.
+static unsigned int simplewq_discard_queued(void)
+{
+    unsigned long flags;
+    struct list_head *pos, *n;
+    simple_work_t *work_item;
+    struct simple_pool *pool;
+    unsigned int nr = 0;
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        pool = per_cpu_ptr(&simple_pools, cpu);
+        spin_lock_irqsave(&pool->lock, flags);
+        simple_llist_to_list(llist_del_all(&pool->lockless_list), &pool->work_list);
+        list_for_each_safe(pos, n, &pool->work_list) {
+            work_item = list_entry(pos, simple_work_t, list);
+            list_del(&work_item->list);
+            defer_dbg("SimpleWQ: Cleaning work for function %pS\n", work_item->func);
+            // Embedded items belong to their callers; only drop the pending bit
+            if (test_bit(SIMPLE_WORK_OWNED, &work_item->flags)) {
+                trace_defer_free(work_item, 0, false);
+                kmem_cache_free(simple_work_cache, work_item);
+                atomic_long_dec(&simple_owned_live);
+            } else
+                clear_bit(SIMPLE_WORK_PENDING, &work_item->flags);
+            nr++;
+        }
+        pool->nr_queued = 0;
+        spin_unlock_irqrestore(&pool->lock, flags);
+    }
+    return nr;
+}
+
+// --- Module Init/Exit ---
+
 static int __init ex3_init(void)
 {
+    simple_work_t *batch[SIMPLE_DEMO_REQS];
+    struct simple_pool *pool;
+    int cpu, ret, i;
+
     pr_info("SimpleWQ Module: Loading...\n");
 
-    // Initialize the wait queue
-    init_waitqueue_head(&worker_waitqueue);
+    // Initialize every pool, including CPUs that may come online later
+    for_each_possible_cpu(cpu) {
+        pool = per_cpu_ptr(&simple_pools, cpu);
+        INIT_LIST_HEAD(&pool->work_list);
+        init_llist_head(&pool->lockless_list);
+        spin_lock_init(&pool->lock);
+        init_waitqueue_head(&pool->waitqueue);
+        INIT_LIST_HEAD(&pool->workers);
+        atomic_set(&pool->nr_running, 0);
+        pool->cpu = cpu;
+    }
 
-    // Create and start the worker thread
-    worker_thread = kthread_run(worker_thread_fn, NULL, "simple_worker");
-    if (IS_ERR(worker_thread)) {
-        pr_err("SimpleWQ: Failed to create worker thread (%ld)\n", PTR_ERR(worker_thread));
-        return PTR_ERR(worker_thread);
+    // Create slab cache for allocated work items
+    simple_work_cache = kmem_cache_create("simplewq_work_cache", // Name
+                                          sizeof(simple_work_t), // Size of objects
+                                          0, // Alignment (0 = default)
+                                          SLAB_HWCACHE_ALIGN, // Keep items off shared lines
+                                          NULL); // Constructor (none needed)
+    if (!simple_work_cache) {
+        pr_err("SimpleWQ: Failed to create slab cache.\n");
+        return -ENOMEM;
+    }
+
+    ret = simplewq_start();
+    if (ret) {
+        kmem_cache_destroy(simple_work_cache);
+        return ret;
+    }
+
+    if (!proc_create(PROC_FILENAME, 0444, NULL, &simplewq_stats_fops)) {
+        pr_err("SimpleWQ: Failed to create /proc/%s entry.\n", PROC_FILENAME);
+        simplewq_stop();
+        kmem_cache_destroy(simple_work_cache);
+        return -ENOMEM;
+    }
+    if (!proc_create(PROC_WORKERS_FILENAME, 0444, NULL, &simplewq_workers_fops)) {
+        pr_err("SimpleWQ: Failed to create /proc/%s entry.\n", PROC_WORKERS_FILENAME);
+        remove_proc_entry(PROC_FILENAME, NULL);
+        simplewq_stop();
+        kmem_cache_destroy(simple_work_cache);
+        return -ENOMEM;
     }
 
     // Submit some work items
     submit_work(simple_do_work, 1);
     submit_work(simple_do_work, 2);
-    msleep(10); // Give worker time to process first batch
+    msleep(10); // Give workers time to process first batch
     submit_work(simple_do_work, 3);
 
+    // And some embedded in a caller structure (no allocation): one on its
+    // own, the rest as a single batch with at most one wakeup
+    for (i = 0; i < SIMPLE_DEMO_REQS; i++) {
+        simple_demo_reqs[i].id = 4 + i;
+        INIT_SIMPLE_WORK(&simple_demo_reqs[i].work, simple_demo_work);
+        batch[i] = &simple_demo_reqs[i].work;
+    }
+    queue_simple_work(batch[0]);
+    submit_work_batch(&batch[1], SIMPLE_DEMO_REQS - 1);
+
     pr_info("SimpleWQ Module: Loaded successfully.\n");
     return 0;
 }
 
 static void __exit ex3_exit(void)
 {
-    unsigned long flags;
-    struct list_head *pos, *n;
-    simple_work_t *work_item;
-
     pr_info("SimpleWQ Module: Exiting...\n");
 
-    // Stop the worker thread
-    if (worker_thread) {
-        pr_info("SimpleWQ: Stopping worker thread...\n");
-        kthread_stop(worker_thread);
-        worker_thread = NULL;
-        pr_info("SimpleWQ: Worker thread stopped.\n");
-    }
+    remove_proc_entry(PROC_WORKERS_FILENAME, NULL);
+    remove_proc_entry(PROC_FILENAME, NULL);
 
-    // Cleanup any remaining work items in the list (important!)
-    pr_info("SimpleWQ: Cleaning up remaining work items...\n");
-    spin_lock_irqsave(&list_lock, flags);
-    list_for_each_safe(pos, n, &work_list) {
-        work_item = list_entry(pos, simple_work_t, list);
-        list_del(&work_item->list);
-        pr_info("SimpleWQ: Cleaning work with data ID %d\n", *(int *)work_item->data);
-        kfree(work_item->data);
-        kfree(work_item);
-    }
-    spin_unlock_irqrestore(&list_lock, flags);
-    pr_info("SimpleWQ: Cleanup complete.\n");
+    pr_info("SimpleWQ: Stopping worker threads...\n");
+    simplewq_stop();
+    pr_info("SimpleWQ: Worker threads stopped.\n");
+
+    // Cleanup any remaining work items in the lists (important!)
+    pr_info("SimpleWQ: Cleaned up %u remaining work items.\n", simplewq_discard_queued());
+
+    // Destroy slab cache (must be done after all objects freed)
+    kmem_cache_destroy(simple_work_cache);
 
     pr_info("SimpleWQ Module: Unloaded.\n");
 }
@@ -178,4 +1324,8 @@ module_exit(ex3_exit);
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Oliver Jędrzejczyk");
 MODULE_DESCRIPTION("Exercise 3: Simplified work queue implementation");
-MODULE_VERSION("1.0");
\ No newline at end of file
+MODULE_VERSION("1.0");
+
+#if IS_ENABLED(CONFIG_OSLAB_DEFER_KUNIT_TEST)
+#include "ex3_test.c" // KUnit suite; uses the static functions above
+#endif
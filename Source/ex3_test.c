@@ -0,0 +1,246 @@
+// KUnit suite for SimpleWQ. Built into ex3.o (ex3.c includes this file
+// when CONFIG_OSLAB_DEFER_KUNIT_TEST is set) so it can reach the static
+// queue functions; run it with kunit.py, see Kbuild.
+//
+// Correctness: FIFO order per CPU for single, batched, spinlock and
+// lock-free submission; pending items dropped (not run) when the engine
+// stops; no allocated items left behind. Timing: submit cost per item and
+// drain time, reported with kunit_info() and checked against the budgets
+// below when those are set (e.g. ex3.kunit_submit_budget_ns=500 on the
+// kunit.py --kernel_args command line).
+
+#include "defer_test.h"     // Shared fixture, kunit_drain_budget_ns
+
+static unsigned int kunit_submit_budget_ns;
+module_param(kunit_submit_budget_ns, uint, 0644);
+MODULE_PARM_DESC(kunit_submit_budget_ns, "KUnit: fail if a submit costs more than this (ns, 0 = report only)");
+
+#define SIMPLE_TEST_ITEMS   256
+#define SIMPLE_BENCH_ITEMS  10000
+
+struct simple_test_item {
+    simple_work_t work;
+    unsigned int seq;
+    struct defer_test_ctx *ctx;
+};
+
+struct simple_test_ctx {
+    struct defer_test_ctx t;
+    struct simple_test_item *items;
+};
+
+// Module parameters the tests change, restored after each case
+static bool simple_test_saved_lockless;
+static unsigned int simple_test_saved_steal;
+
+static void simple_test_fn(void *data)
+{
+    struct simple_test_item *item = container_of(data, struct simple_test_item, work);
+
+    defer_test_record(item->ctx, item->seq);
+}
+
+static struct simple_test_ctx *simple_test_ctx_alloc(struct kunit *test, unsigned int nr)
+{
+    struct simple_test_ctx *ctx;
+    unsigned int i;
+
+    ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, ctx);
+    ctx->items = kunit_kcalloc(test, nr, sizeof(*ctx->items), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, ctx->items);
+    defer_test_ctx_init(test, &ctx->t, nr);
+
+    for (i = 0; i < nr; i++) {
+        ctx->items[i].seq = i;
+        ctx->items[i].ctx = &ctx->t;
+        INIT_SIMPLE_WORK(&ctx->items[i].work, simple_test_fn);
+    }
+    return ctx;
+}
+
+// Wait for every item of ctx to run. On timeout the engine is restarted
+// with the stragglers discarded, so the kunit-managed items can be freed.
+static bool simple_test_wait(struct kunit *test, struct simple_test_ctx *ctx)
+{
+    if (defer_test_wait(test, &ctx->t))
+        return true;
+
+    simplewq_stop();
+    simplewq_discard_queued();
+    simplewq_start();
+    return false;
+}
+
+// Queue every item one by one from a single CPU
+static void simple_test_fifo_single(struct kunit *test, bool lockless)
+{
+    struct simple_test_ctx *ctx = simple_test_ctx_alloc(test, SIMPLE_TEST_ITEMS);
+    unsigned int i;
+
+    WRITE_ONCE(lockless_submit, lockless);
+    migrate_disable(); // Same pool for all of them
+    for (i = 0; i < ctx->t.nr; i++)
+        KUNIT_EXPECT_TRUE(test, queue_simple_work(&ctx->items[i].work));
+    migrate_enable();
+
+    if (simple_test_wait(test, ctx))
+        defer_test_check_order(test, &ctx->t);
+}
+
+static void simplewq_test_fifo_spinlock(struct kunit *test)
+{
+    simple_test_fifo_single(test, false);
+}
+
+static void simplewq_test_fifo_lockless(struct kunit *test)
+{
+    simple_test_fifo_single(test, true);
+}
+
+// Batches keep array order, and consecutive batches keep theirs
+static void simplewq_test_fifo_batch(struct kunit *test)
+{
+    struct simple_test_ctx *ctx;
+    simple_work_t **works;
+    unsigned int i, mode, chunk = 32;
+
+    for (mode = 0; mode < 2; mode++) {
+        ctx = simple_test_ctx_alloc(test, SIMPLE_TEST_ITEMS);
+        works = kunit_kcalloc(test, ctx->t.nr, sizeof(*works), GFP_KERNEL);
+        KUNIT_ASSERT_NOT_NULL(test, works);
+        for (i = 0; i < ctx->t.nr; i++)
+            works[i] = &ctx->items[i].work;
+
+        WRITE_ONCE(lockless_submit, mode);
+        migrate_disable();
+        for (i = 0; i < ctx->t.nr; i += chunk)
+            KUNIT_EXPECT_EQ(test, submit_work_batch(&works[i], min(chunk, ctx->t.nr - i)),
+                            min(chunk, ctx->t.nr - i));
+        migrate_enable();
+
+        if (!simple_test_wait(test, ctx))
+            return;
+        defer_test_check_order(test, &ctx->t);
+    }
+}
+
+static atomic_t simple_test_inline_ran;
+
+static void simple_test_inline_fn(void *data)
+{
+    atomic_inc(&simple_test_inline_ran);
+}
+
+// Stopping the engine with items still queued: nothing runs, embedded
+// items are released, allocated ones freed, and a second queue attempt
+// on a pending item is refused
+static void simplewq_test_stop_discards(struct kunit *test)
+{
+    struct simple_test_ctx *ctx = simple_test_ctx_alloc(test, SIMPLE_TEST_ITEMS);
+    long live = atomic_long_read(&simple_owned_live);
+    unsigned int i, nr_inline = 16;
+    int id;
+
+    simplewq_stop();
+    WRITE_ONCE(lockless_submit, true); // Pools take lock-free pushes while stopped
+    atomic_set(&simple_test_inline_ran, 0);
+
+    for (i = 0; i < ctx->t.nr; i++)
+        KUNIT_EXPECT_TRUE(test, queue_simple_work(&ctx->items[i].work));
+    KUNIT_EXPECT_FALSE(test, queue_simple_work(&ctx->items[0].work)); // Still pending
+    for (id = 0; id < nr_inline; id++)
+        KUNIT_EXPECT_EQ(test, submit_work_inline(simple_test_inline_fn, &id, sizeof(id)), 0);
+    KUNIT_EXPECT_EQ(test, atomic_long_read(&simple_owned_live), live + nr_inline);
+
+    KUNIT_EXPECT_EQ(test, simplewq_discard_queued(), ctx->t.nr + nr_inline);
+    KUNIT_EXPECT_EQ(test, simplewq_start(), 0);
+
+    KUNIT_EXPECT_EQ(test, atomic_read(&ctx->t.ran), 0);
+    KUNIT_EXPECT_EQ(test, atomic_read(&simple_test_inline_ran), 0);
+    KUNIT_EXPECT_EQ(test, atomic_long_read(&simple_owned_live), live);
+    for (i = 0; i < ctx->t.nr; i++)
+        KUNIT_EXPECT_FALSE(test, test_bit(SIMPLE_WORK_PENDING, &ctx->items[i].work.flags));
+
+    // Released items can be queued again and do run
+    for (i = 0; i < ctx->t.nr; i++)
+        queue_simple_work(&ctx->items[i].work);
+    simple_test_wait(test, ctx);
+}
+
+// Every item SimpleWQ allocates is freed once it has run
+static void simplewq_test_no_leak(struct kunit *test)
+{
+    long live = atomic_long_read(&simple_owned_live);
+    unsigned long deadline;
+    int id;
+
+    atomic_set(&simple_test_inline_ran, 0);
+    for (id = 0; id < SIMPLE_TEST_ITEMS; id++)
+        KUNIT_ASSERT_EQ(test, submit_work_inline(simple_test_inline_fn, &id, sizeof(id)), 0);
+
+    // The worker frees an item right after its function returns
+    deadline = jiffies + DEFER_TEST_TIMEOUT;
+    while (atomic_long_read(&simple_owned_live) != live && time_before(jiffies, deadline))
+        msleep(1);
+    KUNIT_EXPECT_EQ(test, atomic_read(&simple_test_inline_ran), SIMPLE_TEST_ITEMS);
+    KUNIT_EXPECT_EQ(test, atomic_long_read(&simple_owned_live), live);
+}
+
+// Submit cost per item and drain time per item, for both submission paths
+static void simplewq_bench_submit_drain(struct kunit *test)
+{
+    struct simple_test_ctx *ctx;
+    unsigned int i, mode;
+    u64 t0, t1;
+
+    for (mode = 0; mode < 2; mode++) {
+        ctx = simple_test_ctx_alloc(test, SIMPLE_BENCH_ITEMS);
+        WRITE_ONCE(lockless_submit, mode);
+
+        migrate_disable();
+        t0 = ktime_get_ns();
+        for (i = 0; i < ctx->t.nr; i++)
+            queue_simple_work(&ctx->items[i].work);
+        t1 = ktime_get_ns();
+        migrate_enable();
+        if (!simple_test_wait(test, ctx))
+            return;
+
+        defer_test_report(test, &ctx->t, mode ? "lock-free" : "spinlock", t0, t1,
+                          kunit_submit_budget_ns);
+    }
+}
+
+static int simplewq_test_init(struct kunit *test)
+{
+    simple_test_saved_lockless = READ_ONCE(lockless_submit);
+    simple_test_saved_steal = READ_ONCE(steal_threshold);
+    // No stealing: ordering is only promised per CPU
+    WRITE_ONCE(steal_threshold, UINT_MAX);
+    return 0;
+}
+
+static void simplewq_test_exit(struct kunit *test)
+{
+    WRITE_ONCE(lockless_submit, simple_test_saved_lockless);
+    WRITE_ONCE(steal_threshold, simple_test_saved_steal);
+}
+
+static struct kunit_case simplewq_test_cases[] = {
+    KUNIT_CASE(simplewq_test_fifo_spinlock),
+    KUNIT_CASE(simplewq_test_fifo_lockless),
+    KUNIT_CASE(simplewq_test_fifo_batch),
+    KUNIT_CASE(simplewq_test_stop_discards),
+    KUNIT_CASE(simplewq_test_no_leak),
+    KUNIT_CASE_SLOW(simplewq_bench_submit_drain),
+    {}
+};
+
+static struct kunit_suite simplewq_test_suite = {
+    .name = "simplewq",
+    .init = simplewq_test_init,
+    .exit = simplewq_test_exit,
+    .test_cases = simplewq_test_cases,
+};
+kunit_test_suite(simplewq_test_suite);
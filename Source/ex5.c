@@ -3,10 +3,181 @@
 #include <linux/workqueue.h> // work queue API
 #include <linux/printk.h>    // pr_info
 #include <linux/jiffies.h>   // jiffies, HZ
+#include <linux/hrtimer.h>   // High-resolution periodic mode
+#include <linux/ktime.h>     // ktime_get_ns
+#include <linux/log2.h>      // ilog2
+#include <linux/math64.h>    // div64_u64
+#include <linux/proc_fs.h>   // Proc filesystem
+#include <linux/seq_file.h>  // seq_file API for proc
+#include <linux/string.h>    // sysfs_match_string
+#include <linux/version.h>   // LINUX_VERSION_CODE
+#include <linux/slab.h>      // kcalloc
+#include <linux/llist.h>     // Due-job batches
+#include <linux/spinlock.h>  // Job heap lock
+#include "defer_log.h"       // defer_dbg, verbose parameter
+#include "defer_stats.h"     // defer_hist_percentile
+
+#define DEFER_TRACE_SYSTEM ex5
+#define CREATE_TRACE_POINTS
+#include "defer_trace.h"     // defer_schedule/start/end/free events
+
+DEFINE_DEFER_VERBOSE();
+
+#define PROC_FILENAME "ex5_stats"
+
+// Periodic modes:
+//   delayed - the original: the handler re-arms schedule_delayed_work()
+//             one period after it ran, so runtime and queueing delay
+//             accumulate as drift, and the period is rounded to jiffies
+//   hrtimer - an hrtimer re-armed against absolute deadlines (start + n *
+//             period) queues the handler on system_highpri_wq; lateness
+//             no longer accumulates
+//   jobs    - nr_jobs periodic jobs with different periods in one min-heap
+//             driven by a single hrtimer (see "Job scheduler" below)
+//   adaptive - a poller whose interval halves toward adapt_min_us while it
+//             finds work and doubles toward adapt_max_us while idle, fed
+//             by a simulated event source (see "Adaptive polling" below)
+// The first three record lateness against the intended deadline of each
+// run and the first two also track drift against the ideal grid, so they
+// can be compared in /proc/ex5_stats. adaptive records detection latency
+// instead.
+enum {
+    EX5_MODE_DELAYED,
+    EX5_MODE_HRTIMER,
+    EX5_MODE_JOBS,
+    EX5_MODE_ADAPTIVE,
+    EX5_NR_MODES,
+};
+
+static const char * const ex5_mode_names[EX5_NR_MODES] = {
+    [EX5_MODE_DELAYED] = "delayed",
+    [EX5_MODE_HRTIMER] = "hrtimer",
+    [EX5_MODE_JOBS] = "jobs",
+    [EX5_MODE_ADAPTIVE] = "adaptive",
+};
+
+static int ex5_mode = EX5_MODE_DELAYED;
+
+static int ex5_mode_set(const char *val, const struct kernel_param *kp)
+{
+    int mode = sysfs_match_string(ex5_mode_names, val);
+
+    if (mode < 0)
+        return mode;
+    ex5_mode = mode;
+    return 0;
+}
+
+static int ex5_mode_get(char *buffer, const struct kernel_param *kp)
+{
+    return sysfs_emit(buffer, "%s\n", ex5_mode_names[ex5_mode]);
+}
+
+static const struct kernel_param_ops ex5_mode_ops = {
+    .set = ex5_mode_set,
+    .get = ex5_mode_get,
+};
+module_param_cb(mode, &ex5_mode_ops, NULL, 0444);
+MODULE_PARM_DESC(mode, "Periodic engine: delayed, hrtimer, jobs or adaptive");
+
+static unsigned int period_us = 1000000;
+module_param(period_us, uint, 0444);
+MODULE_PARM_DESC(period_us, "Period (us); delayed mode rounds it up to jiffies");
+
+static unsigned int max_runs = 5;
+module_param(max_runs, uint, 0444);
+MODULE_PARM_DESC(max_runs, "Stop after this many runs (0 = run until unload); not used by jobs/adaptive");
+
+static unsigned int nr_jobs = 1024;
+module_param(nr_jobs, uint, 0444);
+MODULE_PARM_DESC(nr_jobs, "jobs mode: number of periodic jobs");
+
+static unsigned int slack_us;
+module_param(slack_us, uint, 0444);
+MODULE_PARM_DESC(slack_us, "jobs mode: run jobs due within this much of each other together (us)");
+
+static unsigned int adapt_min_us = 10000;
+module_param(adapt_min_us, uint, 0444);
+MODULE_PARM_DESC(adapt_min_us, "adaptive mode: shortest poll interval (us)");
+
+static unsigned int adapt_max_us = 2000000;
+module_param(adapt_max_us, uint, 0444);
+MODULE_PARM_DESC(adapt_max_us, "adaptive mode: longest poll interval (us)");
+
+static unsigned int src_burst = 50;
+module_param(src_burst, uint, 0444);
+MODULE_PARM_DESC(src_burst, "adaptive mode: events per simulated burst");
+
+static unsigned int src_gap_ms = 20;
+module_param(src_gap_ms, uint, 0444);
+MODULE_PARM_DESC(src_gap_ms, "adaptive mode: time between events in a burst (ms)");
+
+static unsigned int src_idle_ms = 10000;
+module_param(src_idle_ms, uint, 0444);
+MODULE_PARM_DESC(src_idle_ms, "adaptive mode: quiet time between bursts (ms)");
+
+// Lateness histogram: bucket i counts runs 2^i..2^(i+1)-1 ns late
+#define EX5_LAT_BUCKETS 32
+
+// Written only by the work handler (never concurrent with itself), except
+// missed/overruns in jobs mode, which only the timer writes; read
+// locklessly by /proc. In adaptive mode runs counts polls and the latency
+// fields hold detection latency.
+static struct {
+    unsigned long runs;
+    unsigned long missed;    // Grid deadlines that passed without a run
+    unsigned long overruns;  // Still queued from the last period when due again
+    u64 lat_sum_ns;
+    u64 lat_max_ns;
+    s64 drift_ns;            // Last run vs. start + runs * period
+    unsigned long lat_hist[EX5_LAT_BUCKETS];
+} ex5_stats;
+
+static u64 ex5_start_ns;    // First deadline; origin of the ideal grid
+static u64 ex5_deadline_ns; // Intended deadline of the next run
+static bool ex5_stopping;
+static struct hrtimer ex5_timer;
 
 // Forward declaration needed
 static struct delayed_work ex5_delayed_work;
 
+static u64 ex5_period_ns(void)
+{
+    return (u64)period_us * NSEC_PER_USEC;
+}
+
+static void ex5_record_latency(u64 lat)
+{
+    int bucket = lat ? min_t(int, ilog2(lat), EX5_LAT_BUCKETS - 1) : 0;
+
+    WRITE_ONCE(ex5_stats.lat_sum_ns, ex5_stats.lat_sum_ns + lat);
+    if (lat > ex5_stats.lat_max_ns)
+        WRITE_ONCE(ex5_stats.lat_max_ns, lat);
+    WRITE_ONCE(ex5_stats.lat_hist[bucket], ex5_stats.lat_hist[bucket] + 1);
+}
+
+static void ex5_record_lateness(u64 now, u64 deadline)
+{
+    WRITE_ONCE(ex5_stats.runs, ex5_stats.runs + 1);
+    ex5_record_latency(now > deadline ? now - deadline : 0);
+}
+
+// Bookkeeping shared by the single-job modes; deadline is when this run
+// was due
+static void ex5_record(u64 deadline)
+{
+    u64 now = ktime_get_ns();
+    u64 since = now > ex5_start_ns ? now - ex5_start_ns : 0;
+    u64 grid_runs = div64_u64(since, ex5_period_ns()) + 1; // Deadlines passed so far
+    unsigned long runs = ex5_stats.runs + 1;
+
+    ex5_record_lateness(now, deadline);
+    WRITE_ONCE(ex5_stats.drift_ns, (s64)(since - (runs - 1) * ex5_period_ns()));
+    // Grid deadlines that have passed without a run of their own
+    if (grid_runs > runs && grid_runs - runs > ex5_stats.missed)
+        WRITE_ONCE(ex5_stats.missed, grid_runs - runs);
+}
+
 // Delayed work handler - reschedules itself!
 static void ex5_work_handler(struct work_struct *work)
 {
@@ -14,29 +185,492 @@ static void ex5_work_handler(struct work_struct *work)
     // We need the delayed_work struct to reschedule, not just work_struct
     // struct delayed_work *dwork = container_of(work, struct delayed_work, work);
     // Actually, DECLARE_DELAYED_WORK gives us the instance directly.
+    unsigned long delay;
 
-    pr_info("Ex5 Repetitive Delayed Work: Handler execution #%d\n", ++count);
+    ex5_record(READ_ONCE(ex5_deadline_ns));
+    trace_defer_start(work, count, false);
+    defer_dbg("Ex5 Repetitive Delayed Work: Handler execution #%d\n", ++count);
 
-    // Reschedule myself for 1 second later
-    if (count < 5) { // Limit for testing
-        pr_info("Ex5 Repetitive Delayed Work: Rescheduling for 1 second later.\n");
+    // Reschedule myself one period later
+    if (!max_runs || count < max_runs) {
+        defer_dbg("Ex5 Repetitive Delayed Work: Rescheduling for %u us later.\n", period_us);
+        delay = max(usecs_to_jiffies(period_us), 1UL);
+        WRITE_ONCE(ex5_deadline_ns, ktime_get_ns() + (u64)jiffies_to_usecs(delay) * NSEC_PER_USEC);
         // Use the SAME delayed_work structure instance
-        schedule_delayed_work(&ex5_delayed_work, HZ); // HZ = 1 second delay
+        trace_defer_schedule(work, count, false);
+        schedule_delayed_work(&ex5_delayed_work, delay);
     } else {
         pr_info("Ex5 Repetitive Delayed Work: Reached limit, stopping rescheduling.\n");
     }
+    trace_defer_end(work, count, false);
 }
 
 // Statically declare the delayed work item
 static DECLARE_DELAYED_WORK(ex5_delayed_work, ex5_work_handler);
 
+// --- hrtimer mode ---
+
+// Work item the timer hands each period to; runs in process context
+static void ex5_hr_work_handler(struct work_struct *work)
+{
+    static int count = 0;
+
+    ex5_record(READ_ONCE(ex5_deadline_ns));
+    trace_defer_start(work, count, true);
+    defer_dbg("Ex5 hrtimer Work: Handler execution #%d\n", ++count);
+    if (max_runs && count >= max_runs && !READ_ONCE(ex5_stopping)) {
+        pr_info("Ex5 hrtimer Work: Reached limit, stopping timer.\n");
+        WRITE_ONCE(ex5_stopping, true);
+        hrtimer_cancel(&ex5_timer); // The callback never waits for us
+    }
+    trace_defer_end(work, count, true);
+}
+
+static DECLARE_WORK(ex5_hr_work, ex5_hr_work_handler);
+
+static enum hrtimer_restart ex5_timer_fn(struct hrtimer *timer)
+{
+    ktime_t expires = hrtimer_get_expires(timer);
+
+    if (READ_ONCE(ex5_stopping))
+        return HRTIMER_NORESTART;
+
+    // Publish the deadline before queueing so the run cannot miss it. A
+    // run still queued from the last period absorbs this one and is then
+    // measured against the newer deadline.
+    WRITE_ONCE(ex5_deadline_ns, ktime_to_ns(expires));
+    if (queue_work(system_highpri_wq, &ex5_hr_work)) {
+        trace_defer_schedule(&ex5_hr_work, 0, true);
+    } else {
+        WRITE_ONCE(ex5_stats.overruns, ex5_stats.overruns + 1);
+    }
+
+    // Next deadline on the absolute grid. If we are more than a period
+    // late, hrtimer_forward() skips the deadlines already passed; those
+    // show up as "missed" when the next run is recorded.
+    hrtimer_forward(timer, hrtimer_cb_get_time(timer), ns_to_ktime(ex5_period_ns()));
+    return HRTIMER_RESTART;
+}
+
+static void ex5_timer_setup(struct hrtimer *timer,
+                            enum hrtimer_restart (*fn)(struct hrtimer *))
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+    hrtimer_setup(timer, fn, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+#else
+    hrtimer_init(timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+    timer->function = fn;
+#endif
+}
+
+// --- Job scheduler ---
+//
+// Thousands of periodic jobs share one hrtimer. Jobs sit in a binary
+// min-heap keyed by their next deadline and the timer is always armed for
+// the heap top. When it fires, every job due by now + slack is popped,
+// moved one period ahead and pushed back, and the due jobs are handed as
+// one batch to ex5_jobs_work on system_highpri_wq. The timer is armed with
+// hrtimer_start_range_ns() using the same slack, so the timer core can fold
+// our wakeup into a nearby one as well.
+//
+// ex5_jobs_lock protects the heap and the timer arming; the timer callback
+// never returns HRTIMER_RESTART, it re-arms with hrtimer_start under the
+// lock like everybody else.
+
+struct ex5_job {
+    u64 next_ns;   // Next deadline
+    u64 due_ns;    // Deadline of the run in the current batch
+    u64 period_ns;
+    unsigned int id;
+    unsigned long runs;
+    struct llist_node batch_node;
+    unsigned long in_batch; // Bit 0: queued in ex5_jobs_batch
+    void (*fn)(struct ex5_job *job);
+};
+
+static struct ex5_job *ex5_jobs;     // nr_jobs entries
+static struct ex5_job **ex5_heap;    // Min-heap on next_ns
+static unsigned int ex5_heap_len;
+static DEFINE_SPINLOCK(ex5_jobs_lock);
+static struct hrtimer ex5_jobs_timer;
+static LLIST_HEAD(ex5_jobs_batch);
+static void ex5_jobs_work_fn(struct work_struct *work);
+static DECLARE_WORK(ex5_jobs_work, ex5_jobs_work_fn); // Runs each batch
+
+static struct {
+    unsigned long wakeups;   // Timer callbacks
+    unsigned long batches;   // Work item runs
+    unsigned long batched;   // Jobs run, summed over batches
+    unsigned long max_batch;
+} ex5_jobs_stats;
+
+static void ex5_heap_swap(unsigned int a, unsigned int b)
+{
+    swap(ex5_heap[a], ex5_heap[b]);
+}
+
+static void ex5_heap_up(unsigned int i)
+{
+    while (i && ex5_heap[i]->next_ns < ex5_heap[(i - 1) / 2]->next_ns) {
+        ex5_heap_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void ex5_heap_down(unsigned int i)
+{
+    unsigned int l, min;
+
+    for (;;) {
+        l = 2 * i + 1;
+        min = i;
+        if (l < ex5_heap_len && ex5_heap[l]->next_ns < ex5_heap[min]->next_ns)
+            min = l;
+        if (l + 1 < ex5_heap_len && ex5_heap[l + 1]->next_ns < ex5_heap[min]->next_ns)
+            min = l + 1;
+        if (min == i)
+            return;
+        ex5_heap_swap(i, min);
+        i = min;
+    }
+}
+
+// Arm the timer for the earliest deadline; ex5_jobs_lock held
+static void ex5_jobs_arm_locked(void)
+{
+    if (!ex5_heap_len || READ_ONCE(ex5_stopping))
+        return;
+    hrtimer_start_range_ns(&ex5_jobs_timer, ns_to_ktime(ex5_heap[0]->next_ns),
+                           (u64)slack_us * NSEC_PER_USEC, HRTIMER_MODE_ABS);
+}
+
+// Add a job whose next_ns and period_ns are set. Jobs stay registered until
+// the module is unloaded.
+static void ex5_job_register(struct ex5_job *job)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&ex5_jobs_lock, flags);
+    ex5_heap[ex5_heap_len] = job;
+    ex5_heap_up(ex5_heap_len++);
+    if (ex5_heap[0] == job)
+        ex5_jobs_arm_locked(); // New earliest deadline
+    spin_unlock_irqrestore(&ex5_jobs_lock, flags);
+}
+
+static enum hrtimer_restart ex5_jobs_timer_fn(struct hrtimer *timer)
+{
+    u64 now = ktime_get_ns(), horizon = now + (u64)slack_us * NSEC_PER_USEC, skipped;
+    struct ex5_job *job;
+    bool queued = false;
+
+    WRITE_ONCE(ex5_jobs_stats.wakeups, ex5_jobs_stats.wakeups + 1);
+
+    spin_lock(&ex5_jobs_lock);
+    while (ex5_heap_len && ex5_heap[0]->next_ns <= horizon) {
+        job = ex5_heap[0];
+        if (!test_and_set_bit(0, &job->in_batch)) {
+            job->due_ns = job->next_ns;
+            llist_add(&job->batch_node, &ex5_jobs_batch);
+            queued = true;
+        } else {
+            // Last period's run has not happened yet; this one folds into it
+            WRITE_ONCE(ex5_stats.overruns, ex5_stats.overruns + 1);
+        }
+
+        // Next deadline on the job's own grid, skipping any already passed
+        job->next_ns += job->period_ns;
+        if (job->next_ns <= now) {
+            skipped = div64_u64(now - job->next_ns, job->period_ns) + 1;
+            job->next_ns += skipped * job->period_ns;
+            WRITE_ONCE(ex5_stats.missed, ex5_stats.missed + skipped);
+        }
+        ex5_heap_down(0);
+    }
+    ex5_jobs_arm_locked();
+    spin_unlock(&ex5_jobs_lock);
+
+    if (queued && queue_work(system_highpri_wq, &ex5_jobs_work))
+        trace_defer_schedule(&ex5_jobs_work, 0, true);
+    return HRTIMER_NORESTART; // Re-armed above, if at all
+}
+
+static void ex5_jobs_work_fn(struct work_struct *work)
+{
+    struct llist_node *batch = llist_reverse_order(llist_del_all(&ex5_jobs_batch));
+    struct ex5_job *job, *tmp;
+    unsigned long n = 0;
+    u64 now;
+
+    trace_defer_start(work, 0, true);
+    llist_for_each_entry_safe(job, tmp, batch, batch_node) {
+        now = ktime_get_ns();
+        ex5_record_lateness(now, job->due_ns);
+        clear_bit(0, &job->in_batch); // May be queued again from here on
+        job->runs++;
+        job->fn(job);
+        n++;
+    }
+    if (n) {
+        WRITE_ONCE(ex5_jobs_stats.batches, ex5_jobs_stats.batches + 1);
+        WRITE_ONCE(ex5_jobs_stats.batched, ex5_jobs_stats.batched + n);
+        if (n > ex5_jobs_stats.max_batch)
+            WRITE_ONCE(ex5_jobs_stats.max_batch, n);
+    }
+    trace_defer_end(work, n, true);
+}
+
+static void ex5_job_demo(struct ex5_job *job)
+{
+    defer_dbg("Ex5 Job %u: run #%lu (period %llu us)\n", job->id, job->runs,
+              div_u64(job->period_ns, NSEC_PER_USEC));
+}
+
+// nr_jobs jobs with periods of 1..8 base periods and deadlines spread
+// evenly over one base period, so they do not all fall due at once
+static int ex5_jobs_start(void)
+{
+    unsigned int i;
+
+    ex5_jobs = kcalloc(nr_jobs, sizeof(*ex5_jobs), GFP_KERNEL);
+    ex5_heap = kcalloc(nr_jobs, sizeof(*ex5_heap), GFP_KERNEL);
+    if (!ex5_jobs || !ex5_heap) {
+        kfree(ex5_jobs);
+        kfree(ex5_heap);
+        return -ENOMEM;
+    }
+
+    ex5_timer_setup(&ex5_jobs_timer, ex5_jobs_timer_fn);
+    for (i = 0; i < nr_jobs; i++) {
+        ex5_jobs[i].id = i;
+        ex5_jobs[i].period_ns = ex5_period_ns() * (1 + i % 8);
+        ex5_jobs[i].next_ns = ex5_start_ns + div_u64(ex5_period_ns() * i, nr_jobs);
+        ex5_jobs[i].fn = ex5_job_demo;
+        ex5_job_register(&ex5_jobs[i]);
+    }
+    return 0;
+}
+
+static void ex5_jobs_stop(void)
+{
+    WRITE_ONCE(ex5_stopping, true); // No more arming
+    hrtimer_cancel(&ex5_jobs_timer);
+    cancel_work_sync(&ex5_jobs_work);
+    kfree(ex5_heap);
+    kfree(ex5_jobs);
+}
+
+// --- Adaptive polling ---
+//
+// Most polls of a quiet source find nothing, so a fixed period wastes
+// wakeups. ex5_adapt_poll halves its interval (down to adapt_min_us) each
+// time it finds work and doubles it (up to adapt_max_us) each time it
+// does not. After an empty poll the next one is armed on a deferrable
+// work item, whose timer does not wake an idle CPU and fires with the
+// next regular wakeup instead; while work keeps arriving it uses a normal
+// one so detection latency stays bounded by the interval.
+//
+// The source is simulated: ex5_src_work posts src_burst events src_gap_ms
+// apart, then stays quiet for src_idle_ms. Detection latency is the time
+// from the oldest unconsumed event to the poll that sees it.
+
+static void ex5_adapt_poll(struct work_struct *work);
+static DECLARE_DELAYED_WORK(ex5_adapt_work, ex5_adapt_poll);
+static DECLARE_DEFERRABLE_WORK(ex5_adapt_idle_work, ex5_adapt_poll);
+
+static DEFINE_SPINLOCK(ex5_src_lock);
+static unsigned long ex5_src_pending; // Events posted, not yet polled
+static u64 ex5_src_first_ns;          // Post time of the oldest of them
+
+static unsigned int ex5_adapt_us;     // Current interval
+
+static struct {
+    unsigned long idle_polls;  // Polls armed on the deferrable work
+    unsigned long detections;  // Polls that found events
+    unsigned long events;
+} ex5_adapt_stats;
+
+static void ex5_src_fn(struct work_struct *work)
+{
+    static unsigned int posted;
+    struct delayed_work *dwork = to_delayed_work(work);
+
+    spin_lock(&ex5_src_lock);
+    if (!ex5_src_pending++)
+        ex5_src_first_ns = ktime_get_ns();
+    spin_unlock(&ex5_src_lock);
+
+    if (++posted < src_burst) {
+        schedule_delayed_work(dwork, msecs_to_jiffies(src_gap_ms));
+    } else {
+        posted = 0;
+        schedule_delayed_work(dwork, msecs_to_jiffies(src_idle_ms));
+    }
+}
+
+static DECLARE_DELAYED_WORK(ex5_src_work, ex5_src_fn);
+
+static void ex5_adapt_poll(struct work_struct *work)
+{
+    struct delayed_work *dwork;
+    u64 now = ktime_get_ns(), first;
+    unsigned long n;
+    unsigned int next;
+
+    trace_defer_start(work, ex5_stats.runs, false);
+    spin_lock(&ex5_src_lock);
+    n = ex5_src_pending;
+    first = ex5_src_first_ns;
+    ex5_src_pending = 0;
+    spin_unlock(&ex5_src_lock);
+
+    WRITE_ONCE(ex5_stats.runs, ex5_stats.runs + 1);
+    if (work == &ex5_adapt_idle_work.work)
+        WRITE_ONCE(ex5_adapt_stats.idle_polls, ex5_adapt_stats.idle_polls + 1);
+    if (n) {
+        WRITE_ONCE(ex5_adapt_stats.detections, ex5_adapt_stats.detections + 1);
+        WRITE_ONCE(ex5_adapt_stats.events, ex5_adapt_stats.events + n);
+        ex5_record_latency(now > first ? now - first : 0);
+        next = max(ex5_adapt_us / 2, adapt_min_us);
+    } else {
+        next = min_t(u64, (u64)ex5_adapt_us * 2, adapt_max_us);
+    }
+    WRITE_ONCE(ex5_adapt_us, next);
+    defer_dbg("Ex5 Adaptive Poll: %lu events, next poll in %u us\n", n, next);
+
+    // Re-arm last: the other work item may start as soon as it is queued.
+    // Trace the item being queued, which is not always this one.
+    if (!READ_ONCE(ex5_stopping)) {
+        dwork = n ? &ex5_adapt_work : &ex5_adapt_idle_work;
+        trace_defer_schedule(&dwork->work, ex5_stats.runs, false);
+        schedule_delayed_work(dwork, max(usecs_to_jiffies(next), 1UL));
+    }
+    trace_defer_end(work, n, false);
+}
+
+static void ex5_adapt_start(void)
+{
+    ex5_adapt_us = clamp(period_us, adapt_min_us, adapt_max_us);
+    schedule_delayed_work(&ex5_src_work, 2 * HZ);
+    trace_defer_schedule(&ex5_adapt_idle_work.work, 0, false);
+    schedule_delayed_work(&ex5_adapt_idle_work, 2 * HZ);
+}
+
+static void ex5_adapt_stop(void)
+{
+    WRITE_ONCE(ex5_stopping, true);
+    // Each poll arms the other item, so one may have been armed by a poll
+    // that ran before it saw ex5_stopping: cancel the first one again
+    cancel_delayed_work_sync(&ex5_adapt_work);
+    cancel_delayed_work_sync(&ex5_adapt_idle_work);
+    cancel_delayed_work_sync(&ex5_adapt_work);
+    cancel_delayed_work_sync(&ex5_src_work);
+}
+
+// --- Proc File Implementation ---
+
+static void ex5_adapt_show(struct seq_file *m, unsigned long polls)
+{
+    u64 now = ktime_get_ns();
+    u64 elapsed_ms = now > ex5_start_ns ? div_u64(now - ex5_start_ns, NSEC_PER_MSEC) : 0;
+    unsigned long samples = READ_ONCE(ex5_adapt_stats.detections);
+
+    seq_printf(m, "Interval:    %u us (range %u..%u us)\n", READ_ONCE(ex5_adapt_us),
+               adapt_min_us, adapt_max_us);
+    seq_printf(m, "Polls:       %lu (%lu deferrable)\n", polls,
+               READ_ONCE(ex5_adapt_stats.idle_polls));
+    seq_printf(m, "Wakeups/s:   %llu.%03llu\n",
+               elapsed_ms ? div64_u64((u64)polls * MSEC_PER_SEC, elapsed_ms) : 0,
+               elapsed_ms ? div64_u64((u64)polls * MSEC_PER_SEC * 1000, elapsed_ms) % 1000 : 0);
+    seq_printf(m, "Events:      %lu in %lu polls\n", READ_ONCE(ex5_adapt_stats.events), samples);
+    seq_printf(m, "Detection:   avg %llu p50 <%llu p99 <%llu max %llu ns\n",
+               samples ? div64_u64(READ_ONCE(ex5_stats.lat_sum_ns), samples) : 0,
+               defer_hist_percentile(ex5_stats.lat_hist, EX5_LAT_BUCKETS, samples, 5000),
+               defer_hist_percentile(ex5_stats.lat_hist, EX5_LAT_BUCKETS, samples, 9900),
+               READ_ONCE(ex5_stats.lat_max_ns));
+}
+
+static int ex5_stats_show(struct seq_file *m, void *v)
+{
+    unsigned long runs = READ_ONCE(ex5_stats.runs);
+
+    seq_printf(m, "--- Ex5 Periodic Work ---\n");
+    seq_printf(m, "Mode:        %s, period %u us\n", ex5_mode_names[ex5_mode], period_us);
+    if (ex5_mode == EX5_MODE_ADAPTIVE) {
+        ex5_adapt_show(m, runs);
+        return 0;
+    }
+    seq_printf(m, "Runs:        %lu\n", runs);
+    seq_printf(m, "Missed:      %lu\n", READ_ONCE(ex5_stats.missed));
+    seq_printf(m, "Overruns:    %lu\n", READ_ONCE(ex5_stats.overruns));
+    seq_printf(m, "Lateness:    avg %llu p50 <%llu p99 <%llu max %llu ns\n",
+               runs ? div64_u64(READ_ONCE(ex5_stats.lat_sum_ns), runs) : 0,
+               defer_hist_percentile(ex5_stats.lat_hist, EX5_LAT_BUCKETS, runs, 5000),
+               defer_hist_percentile(ex5_stats.lat_hist, EX5_LAT_BUCKETS, runs, 9900),
+               READ_ONCE(ex5_stats.lat_max_ns));
+    if (ex5_mode != EX5_MODE_JOBS) {
+        seq_printf(m, "Drift:       %lld ns\n", READ_ONCE(ex5_stats.drift_ns));
+        return 0;
+    }
+
+    seq_printf(m, "Jobs:        %u, slack %u us\n", nr_jobs, slack_us);
+    seq_printf(m, "Wakeups:     %lu\n", READ_ONCE(ex5_jobs_stats.wakeups));
+    seq_printf(m, "Batches:     %lu (avg %lu jobs, max %lu)\n",
+               READ_ONCE(ex5_jobs_stats.batches),
+               READ_ONCE(ex5_jobs_stats.batches) ?
+               READ_ONCE(ex5_jobs_stats.batched) / READ_ONCE(ex5_jobs_stats.batches) : 0,
+               READ_ONCE(ex5_jobs_stats.max_batch));
+    return 0;
+}
+
+static int ex5_stats_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, ex5_stats_show, NULL);
+}
+
+static const struct proc_ops ex5_stats_fops = {
+    .proc_open = ex5_stats_open,
+    .proc_read = seq_read,
+    .proc_lseek = seq_lseek,
+    .proc_release = single_release,
+};
+
 static int __init ex5_init(void)
 {
     pr_info("Ex5 Module: Loading...\n");
 
+    if (!period_us || (ex5_mode == EX5_MODE_JOBS && !nr_jobs)) {
+        pr_err("Ex5 Module: period_us and nr_jobs must be non-zero.\n");
+        return -EINVAL;
+    }
+    if (ex5_mode == EX5_MODE_ADAPTIVE && (!adapt_min_us || adapt_min_us > adapt_max_us)) {
+        pr_err("Ex5 Module: need 0 < adapt_min_us <= adapt_max_us.\n");
+        return -EINVAL;
+    }
+    if (!proc_create(PROC_FILENAME, 0444, NULL, &ex5_stats_fops)) {
+        pr_err("Ex5: Failed to create /proc/%s entry.\n", PROC_FILENAME);
+        return -ENOMEM;
+    }
+
     // Schedule the first execution (2 seconds delay initially)
-    pr_info("Ex5 Module: Scheduling first delayed work run (2 seconds delay).\n");
-    schedule_delayed_work(&ex5_delayed_work, 2 * HZ);
+    pr_info("Ex5 Module: Scheduling first %s run (2 seconds delay).\n", ex5_mode_names[ex5_mode]);
+    ex5_start_ns = ktime_get_ns() + 2 * NSEC_PER_SEC;
+    ex5_deadline_ns = ex5_start_ns;
+
+    if (ex5_mode == EX5_MODE_ADAPTIVE) {
+        ex5_adapt_start();
+    } else if (ex5_mode == EX5_MODE_JOBS) {
+        if (ex5_jobs_start()) {
+            remove_proc_entry(PROC_FILENAME, NULL);
+            return -ENOMEM;
+        }
+    } else if (ex5_mode == EX5_MODE_HRTIMER) {
+        ex5_timer_setup(&ex5_timer, ex5_timer_fn);
+        hrtimer_start(&ex5_timer, ns_to_ktime(ex5_start_ns), HRTIMER_MODE_ABS);
+    } else {
+        trace_defer_schedule(&ex5_delayed_work.work, 0, false);
+        schedule_delayed_work(&ex5_delayed_work, 2 * HZ);
+    }
 
     return 0; // Success
 }
@@ -45,9 +679,23 @@ static void __exit ex5_exit(void)
 {
     pr_info("Ex5 Module: Exiting...\n");
 
-    // CRITICAL: Cancel the delayed work. This prevents it from running
-    // or rescheduling after the module code is gone. Waits if running.
-    if (cancel_delayed_work_sync(&ex5_delayed_work)) {
+    remove_proc_entry(PROC_FILENAME, NULL);
+
+    if (ex5_mode == EX5_MODE_ADAPTIVE) {
+        ex5_adapt_stop();
+        pr_info("Ex5 Module: Adaptive poller stopped.\n");
+    } else if (ex5_mode == EX5_MODE_JOBS) {
+        ex5_jobs_stop();
+        pr_info("Ex5 Module: Job scheduler stopped.\n");
+    } else if (ex5_mode == EX5_MODE_HRTIMER) {
+        // Timer first, so it cannot queue the work again behind our back
+        WRITE_ONCE(ex5_stopping, true);
+        hrtimer_cancel(&ex5_timer);
+        cancel_work_sync(&ex5_hr_work);
+        pr_info("Ex5 Module: Periodic hrtimer cancelled.\n");
+    } else if (cancel_delayed_work_sync(&ex5_delayed_work)) {
+        // CRITICAL: Cancel the delayed work. This prevents it from running
+        // or rescheduling after the module code is gone. Waits if running.
         pr_info("Ex5 Module: Repetitive delayed work was pending and is now cancelled.\n");
     } else {
         pr_info("Ex5 Module: Repetitive delayed work was not pending (already run or finished).\n");
@@ -62,4 +710,4 @@ module_exit(ex5_exit);
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Oliver Jędrzejczyk");
 MODULE_DESCRIPTION("Exercise 5: Automatically repetitive delayed work");
-MODULE_VERSION("1.0");
\ No newline at end of file
+MODULE_VERSION("1.0");
@@ -6,59 +6,355 @@
 #include <linux/seq_file.h>  // seq_file API for proc
 #include <linux/spinlock.h>  // Spinlocks
 #include <linux/list.h>      // Kernel lists
+#include <linux/rculist.h>   // RCU-protected list walks
+#include <linux/llist.h>     // Lock-free reap lists
+#include <linux/workqueue.h> // Delayed reaper work, BH work items
 #include <linux/jiffies.h>   // jiffies, HZ
 #include <linux/timer.h>     // Kernel timers
 #include <linux/printk.h>    // pr_info
+#include <linux/percpu.h>    // Per-CPU variables
+#include <linux/ktime.h>     // ktime_get_ns
+#include <linux/log2.h>      // ilog2
+#include <linux/uaccess.h>   // copy_from_user
+#include <linux/debugfs.h>   // Binary stats file
+#include <linux/vmalloc.h>   // vmalloc_user for the mmap-able export
+#include <linux/mm.h>        // remap_vmalloc_range
+#include <linux/smp.h>       // smp_call_function_single
+#include <linux/wait_bit.h>  // wait_var_event for in-flight chains
+#include <linux/cpu.h>       // cpus_read_lock
+#include <linux/kthread.h>   // Load generator threads
+#include <linux/mutex.h>     // Generator list
+#include <linux/delay.h>     // usleep_range
+#include <linux/string.h>    // strsep
+#include <linux/math64.h>    // mul_u64_u32_div
+#include <linux/version.h>   // LINUX_VERSION_CODE
+#include "defer_log.h"       // defer_dbg, verbose parameter
+#include "defer_stats.h"     // defer_hist_percentile
+#include "tasklet_stats_abi.h" // Layout of debugfs ex6/stats.bin
+#include "tasklet_dispatch.h" // CPU steering, dispatch parameter
+
+#define DEFER_TRACE_SYSTEM ex6
+#define CREATE_TRACE_POINTS
+#include "defer_trace.h"     // defer_schedule/start/end/free events
+
+DEFINE_DEFER_VERBOSE();
+DEFINE_TASKLET_DISPATCHER(ex6_dispatch); // Steers tasklet-backend entries
 
 #define PROC_FILENAME "tasklet_stats"
+#define PROC_CTL_FILENAME "tasklet_ctl"
+#define TASKLET_MAX_GENERATORS 16
+
+// Entries allocated, linked and sent to one CPU per step of the bulk API
+#define TASKLET_BULK_CHUNK 32
+
+// How long executed entries wait before the reaper frees them; batching
+// lets one RCU grace period cover many entries
+static unsigned int reap_ms = 100;
+module_param(reap_ms, uint, 0644);
+MODULE_PARM_DESC(reap_ms, "Delay before executed tasklet entries are reclaimed (ms)");
+
+// Deferral mechanism behind each entry. BH workqueues (system_bh_wq,
+// system_bh_highpri_wq) are the upstream replacement for tasklets and run
+// in the same softirq context, so the two are directly comparable.
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 9, 0)
+#define EX6_HAVE_BH_WQ 1
+#endif
+
+enum {
+    EX6_BACKEND_TASKLET,
+    EX6_BACKEND_BH,
+    EX6_NR_BACKENDS,
+};
+
+static const char * const ex6_backend_names[EX6_NR_BACKENDS] = {
+    [EX6_BACKEND_TASKLET] = "tasklet",
+    [EX6_BACKEND_BH] = "bh",
+};
+
+static int ex6_backend_parse(const char *val)
+{
+    int backend = sysfs_match_string(ex6_backend_names, val);
+
+#ifndef EX6_HAVE_BH_WQ
+    if (backend == EX6_BACKEND_BH)
+        return -EOPNOTSUPP; // No BH workqueues before 6.9
+#endif
+    return backend;
+}
+
+static int ex6_backend = EX6_BACKEND_TASKLET;
+
+static int ex6_backend_set(const char *val, const struct kernel_param *kp)
+{
+    int backend = ex6_backend_parse(val);
+
+    if (backend < 0)
+        return backend;
+    WRITE_ONCE(ex6_backend, backend);
+    return 0;
+}
+
+static int ex6_backend_get(char *buffer, const struct kernel_param *kp)
+{
+    return sysfs_emit(buffer, "%s\n", ex6_backend_names[READ_ONCE(ex6_backend)]);
+}
+
+static const struct kernel_param_ops ex6_backend_ops = {
+    .set = ex6_backend_set,
+    .get = ex6_backend_get,
+};
+module_param_cb(backend, &ex6_backend_ops, NULL, 0644);
+MODULE_PARM_DESC(backend, "Default mechanism for new entries: tasklet or bh (6.9+)");
+
+// Schedule-to-execute latency histograms: bucket i counts delays of
+// 2^i..2^(i+1)-1 ns; the last bucket also takes everything above
+#define TASKLET_LAT_BUCKETS 32
+
+// Histogram index by priority
+enum {
+    TASKLET_PRIO_NORMAL,
+    TASKLET_PRIO_HIGH,
+    TASKLET_NR_PRIO,
+};
 
 // Structure to hold tasklet info and list linkage
 typedef struct {
-    struct tasklet_struct tasklet;
+    union { // Selected by backend
+        struct tasklet_struct tasklet;
+        struct work_struct work;
+    };
     struct list_head list;
+    struct llist_node reap_node; // On tasklet_reap once executed
+    struct tasklet_dispatch_req dreq; // Tasklet backend only
     unsigned long data; // Example data
     bool high_priority;
     bool executed;
+    u8 backend; // EX6_BACKEND_*
+    u64 sched_ns; // ktime_get_ns() when it was scheduled
 } tasklet_entry_t;
 
 // Slab cache for our tasklet entries
 static struct kmem_cache *tasklet_cache = NULL;
 
-// List to keep track of created tasklets (for cleanup/stats)
+// List to keep track of created tasklets (for cleanup/stats). Readers walk
+// it under rcu_read_lock(); the lock only serialises writers, which all run
+// in process context, so the tasklet handler never has to take it.
 static LIST_HEAD(active_tasklets);
-static DEFINE_SPINLOCK(tasklet_list_lock); // Protect the list
+static DEFINE_SPINLOCK(tasklet_list_lock); // Serialise list updates
+
+// Executed entries waiting to be reclaimed, one lock-free list per CPU so
+// handlers on different CPUs never contend. Drained by tasklet_reaper.
+static DEFINE_PER_CPU(struct llist_head, tasklet_reap);
+static void tasklet_reap_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(tasklet_reaper, tasklet_reap_fn);
+static unsigned long tasklet_reclaimed; // Written only by the reaper
+static bool ex6_exiting;
+
+// Bulk chains handed to a CPU that has not finished scheduling them yet.
+// tasklet_tracking_stop() waits for zero before it touches any entry.
+static atomic_t tasklet_chains_inflight = ATOMIC_INIT(0);
+
+#if IS_ENABLED(CONFIG_OSLAB_DEFER_KUNIT_TEST)
+// Called by every handler run when set; lets the KUnit suite observe runs
+static void (*tasklet_test_hook)(tasklet_entry_t *entry);
+#endif
+
+// Statistics counters, one set per CPU. Each CPU only bumps its own copy
+// with this_cpu_inc(), so the hot paths share no cache lines and need no
+// atomics; the totals are summed when /proc/tasklet_stats is read.
+// Pending is derived as scheduled - executed.
+struct tasklet_cpu_stats {
+    unsigned long created;
+    unsigned long scheduled;
+    unsigned long executed;
+    unsigned long high_prio;
+    unsigned long be_executed[EX6_NR_BACKENDS]; // executed, split by backend
+    // Schedule-to-execute latency, recorded by the handler on this CPU
+    unsigned long lat_hist[EX6_NR_BACKENDS][TASKLET_NR_PRIO][TASKLET_LAT_BUCKETS];
+    u64 lat_max[EX6_NR_BACKENDS][TASKLET_NR_PRIO];
+};
 
-// Statistics counters
-static atomic_t created_count = ATOMIC_INIT(0);
-static atomic_t scheduled_count = ATOMIC_INIT(0);
-static atomic_t executed_count = ATOMIC_INIT(0);
-static atomic_t high_prio_count = ATOMIC_INIT(0);
-static atomic_t pending_count = ATOMIC_INIT(0);
+static DEFINE_PER_CPU(struct tasklet_cpu_stats, tasklet_stats);
+
+// Binary export (see tasklet_stats_abi.h): a vmalloc_user() area that
+// collectors mmap() read-only. A single writer, tasklet_publisher, copies
+// the per-CPU counters in under hdr->seq, so the hot paths are untouched.
+static void *tasklet_export;
+static size_t tasklet_export_size;
+static struct dentry *ex6_debugfs_dir;
+static void tasklet_publish_fn(struct work_struct *work);
+static DECLARE_DEFERRABLE_WORK(tasklet_publisher, tasklet_publish_fn);
+
+// Publisher period. Setting it re-arms the publisher, so a write after
+// "0" (stopped) starts it again and a shorter period applies right away.
+static unsigned int publish_ms = 10;
+
+static int publish_ms_set(const char *val, const struct kernel_param *kp)
+{
+    int ret = param_set_uint(val, kp);
+
+    // Before ex6_init the publisher is armed there instead. ex6_exit takes
+    // the parameter lock after setting ex6_exiting, so it cannot be
+    // re-armed behind its back.
+    if (!ret && READ_ONCE(publish_ms) && tasklet_export && !READ_ONCE(ex6_exiting))
+        mod_delayed_work(system_wq, &tasklet_publisher, 0);
+    return ret;
+}
+
+static const struct kernel_param_ops publish_ms_ops = {
+    .set = publish_ms_set,
+    .get = param_get_uint,
+};
+module_param_cb(publish_ms, &publish_ms_ops, &publish_ms, 0644);
+MODULE_PARM_DESC(publish_ms, "Refresh interval of debugfs ex6/stats.bin (ms, 0 stops)");
+
+// Body shared by both backends; runs in softirq context either way
+static void tasklet_entry_run(tasklet_entry_t *entry)
+{
+    u64 lat = ktime_get_ns() - entry->sched_ns;
+    struct tasklet_cpu_stats *stats = this_cpu_ptr(&tasklet_stats);
+    int prio = entry->high_priority ? TASKLET_PRIO_HIGH : TASKLET_PRIO_NORMAL;
+    int be = entry->backend;
+
+    if (be == EX6_BACKEND_TASKLET)
+        tasklet_dispatch_ran(&ex6_dispatch, &entry->dreq);
+    trace_defer_start(entry, entry->data, entry->high_priority);
+#if IS_ENABLED(CONFIG_OSLAB_DEFER_KUNIT_TEST)
+    {
+        void (*hook)(tasklet_entry_t *entry) = READ_ONCE(tasklet_test_hook);
+
+        if (hook)
+            hook(entry);
+    }
+#endif
+
+    // Softirq context: nothing else on this CPU touches stats meanwhile
+    stats->lat_hist[be][prio][lat ? min_t(int, ilog2(lat), TASKLET_LAT_BUCKETS - 1) : 0]++;
+    if (lat > stats->lat_max[be][prio])
+        stats->lat_max[be][prio] = lat;
+    stats->be_executed[be]++;
+    defer_dbg("Ex6 Tasklet Handler: Executing tasklet created with data: %lu (High Prio: %d)\n",
+              entry->data, entry->high_priority);
+
+    this_cpu_inc(tasklet_stats.executed);
+
+    // Mark as executed; proc readers pick it up with READ_ONCE()
+    WRITE_ONCE(entry->executed, true);
+
+    trace_defer_end(entry, entry->data, entry->high_priority);
+
+    // Hand the entry to the reaper. It stays on active_tasklets until then,
+    // and the reaper waits for this handler to return before freeing it.
+    if (llist_add(&entry->reap_node, this_cpu_ptr(&tasklet_reap)) &&
+        !READ_ONCE(ex6_exiting))
+        schedule_delayed_work(&tasklet_reaper, msecs_to_jiffies(reap_ms));
+}
 
 // Generic tasklet handler
 static void generic_tasklet_handler(unsigned long data)
 {
-    // We need the container structure pointer
-    tasklet_entry_t *entry = (tasklet_entry_t *)data; // We pass the entry address as data
-    unsigned long flags;
+    // We pass the entry address as data
+    tasklet_entry_run((tasklet_entry_t *)data);
+}
+
+static void generic_bh_work_fn(struct work_struct *work)
+{
+    tasklet_entry_run(container_of(work, tasklet_entry_t, work));
+}
+
+static void tasklet_entry_init(tasklet_entry_t *entry, int backend)
+{
+    entry->backend = backend;
+    if (backend == EX6_BACKEND_BH)
+        INIT_WORK(&entry->work, generic_bh_work_fn);
+    else {
+        // Pass the address of the container as data
+        tasklet_init(&entry->tasklet, generic_tasklet_handler, (unsigned long)entry);
+        tasklet_dispatch_req_init(&entry->dreq, &entry->tasklet, entry->high_priority);
+    }
+}
+
+// With steer, tasklets go to the CPU chosen by the dispatch policy;
+// otherwise (preemption disabled) to the current CPU. BH work items always
+// queue locally.
+static void tasklet_entry_schedule(tasklet_entry_t *entry, bool steer)
+{
+#ifdef EX6_HAVE_BH_WQ
+    if (entry->backend == EX6_BACKEND_BH) {
+        queue_work(entry->high_priority ? system_bh_highpri_wq : system_bh_wq,
+                   &entry->work);
+        return;
+    }
+#endif
+    if (steer)
+        tasklet_dispatch(&ex6_dispatch, &entry->dreq);
+    else
+        tasklet_dispatch_to(&ex6_dispatch, &entry->dreq, smp_processor_id());
+}
+
+// Wait until the entry is neither queued nor running; may sleep
+static void tasklet_entry_kill(tasklet_entry_t *entry)
+{
+    if (entry->backend == EX6_BACKEND_BH)
+        cancel_work_sync(&entry->work);
+    else
+        tasklet_kill(&entry->tasklet);
+}
+
+static bool tasklet_entry_pending(tasklet_entry_t *entry)
+{
+    if (entry->backend == EX6_BACKEND_BH)
+        return work_pending(&entry->work);
+    return tasklet_dispatch_pending(&entry->dreq);
+}
+
+// Free executed entries back to ex6_tasklet_cache. Entries are unlinked
+// first, then a single grace period lets proc readers that may still see
+// them finish before the memory is reused.
+static void tasklet_reap_fn(struct work_struct *work)
+{
+    LLIST_HEAD(batch);
+    struct llist_node *node;
+    tasklet_entry_t *entry, *tmp;
+    unsigned long nr = 0;
+    int cpu;
 
-    pr_info("Ex6 Tasklet Handler: Executing tasklet created with data: %lu (High Prio: %d)\n",
-            entry->data, entry->high_priority);
+    if (READ_ONCE(ex6_exiting))
+        return; // tasklet_tracking_stop() frees everything itself
 
-    atomic_inc(&executed_count);
-    atomic_dec(&pending_count);
+    spin_lock(&tasklet_list_lock);
+    for_each_possible_cpu(cpu) {
+        node = llist_del_all(per_cpu_ptr(&tasklet_reap, cpu));
+        llist_for_each_entry_safe(entry, tmp, node, reap_node) {
+            list_del_rcu(&entry->list);
+            llist_add(&entry->reap_node, &batch);
+        }
+    }
+    spin_unlock(&tasklet_list_lock);
+
+    if (llist_empty(&batch))
+        return;
+
+    synchronize_rcu();
 
-    // Mark as executed within the entry itself (requires lock)
-    spin_lock_irqsave(&tasklet_list_lock, flags);
-    entry->executed = true;
-    spin_unlock_irqrestore(&tasklet_list_lock, flags);
+    llist_for_each_entry_safe(entry, tmp, batch.first, reap_node) {
+        // The handler queued the entry from inside itself; wait for it to
+        // actually return before the tasklet/work item goes away
+        tasklet_entry_kill(entry);
+        trace_defer_free(entry, entry->data, entry->high_priority);
+        kmem_cache_free(tasklet_cache, entry);
+        nr++;
+    }
+    WRITE_ONCE(tasklet_reclaimed, tasklet_reclaimed + nr);
+    defer_dbg("Ex6: Reclaimed %lu tasklet entries\n", nr);
 }
 
-// Function to create and schedule a tasklet dynamically
+// Function to create and schedule a tasklet dynamically. The entry is
+// reclaimed shortly after it runs, so the returned pointer is only good
+// for a NULL check.
 static tasklet_entry_t *create_and_schedule_tasklet(unsigned long task_data, bool high_prio)
 {
     tasklet_entry_t *entry;
-    unsigned long flags;
 
     entry = kmem_cache_alloc(tasklet_cache, GFP_KERNEL);
     if (!entry) {
@@ -70,67 +366,444 @@ static tasklet_entry_t *create_and_schedule_tasklet(unsigned long task_data, boo
     entry->data = task_data;
     entry->high_priority = high_prio;
     entry->executed = false;
-    // Initialize the tasklet itself, passing the address of the container as data
-    tasklet_init(&entry->tasklet, generic_tasklet_handler, (unsigned long)entry);
+    // Initialize the tasklet (or BH work item) itself
+    tasklet_entry_init(entry, READ_ONCE(ex6_backend));
 
     // Add to our tracking list
-    spin_lock_irqsave(&tasklet_list_lock, flags);
-    list_add_tail(&entry->list, &active_tasklets);
-    spin_unlock_irqrestore(&tasklet_list_lock, flags);
+    spin_lock(&tasklet_list_lock);
+    list_add_tail_rcu(&entry->list, &active_tasklets);
+    spin_unlock(&tasklet_list_lock);
 
     // Update stats
-    atomic_inc(&created_count);
+    this_cpu_inc(tasklet_stats.created);
     if (high_prio) {
-        atomic_inc(&high_prio_count);
+        this_cpu_inc(tasklet_stats.high_prio);
     }
 
     // Schedule it
-    atomic_inc(&scheduled_count);
-    atomic_inc(&pending_count); // Increment pending count here
-    if (high_prio) {
-        tasklet_hi_schedule(&entry->tasklet);
-    } else {
-        tasklet_schedule(&entry->tasklet);
-    }
-    pr_info("Ex6: Scheduled tasklet (Data: %lu, High Prio: %d)\n", task_data, high_prio);
+    this_cpu_inc(tasklet_stats.scheduled);
+    trace_defer_schedule(entry, task_data, high_prio);
+    entry->sched_ns = ktime_get_ns();
+    tasklet_entry_schedule(entry, true);
+    defer_dbg("Ex6: Scheduled tasklet (Data: %lu, High Prio: %d)\n", task_data, high_prio);
 
     return entry;
 }
 
+// Runs on the target CPU (IPI or local call): schedule a chain of entries
+// there. The chain is threaded through reap_node, which is free until the
+// handler runs, so the next pointer is read before each entry is scheduled.
+static void tasklet_schedule_chain(void *info)
+{
+    tasklet_entry_t *entry, *tmp;
+
+    llist_for_each_entry_safe(entry, tmp, (struct llist_node *)info, reap_node) {
+        trace_defer_schedule(entry, entry->data, entry->high_priority);
+        entry->sched_ns = ktime_get_ns();
+        tasklet_entry_schedule(entry, false);
+    }
+    if (atomic_dec_and_test(&tasklet_chains_inflight))
+        wake_up_var(&tasklet_chains_inflight);
+}
+
+// Bulk version of create_and_schedule_tasklet() for bursts: create nr
+// tasklets with data, data + 1, ... Each chunk of TASKLET_BULK_CHUNK entries
+// costs one kmem_cache_alloc_bulk(), one tracking-list critical section,
+// one stats update and one cross-CPU call. With cpu < 0 the chunks go
+// round-robin over the online CPUs; otherwise all of them go to cpu.
+// backend is EX6_BACKEND_*. Returns the number of tasklets created.
+static unsigned int create_and_schedule_tasklets(unsigned int nr, unsigned long data,
+                                                 bool high_prio, int cpu, int backend)
+{
+    void *objs[TASKLET_BULK_CHUNK];
+    struct llist_node *chain;
+    tasklet_entry_t *entry;
+    unsigned int done = 0, n, i;
+    int target = -1;
+
+    cpus_read_lock(); // Keep the chosen targets online while we IPI them
+    while (done < nr) {
+        n = kmem_cache_alloc_bulk(tasklet_cache, GFP_KERNEL,
+                                  min_t(unsigned int, nr - done, TASKLET_BULK_CHUNK), objs);
+        if (!n) {
+            pr_err("Ex6: Bulk allocation failed after %u tasklets.\n", done);
+            break;
+        }
+
+        chain = NULL;
+        for (i = n; i-- > 0; ) { // Build the chain back to front to keep order
+            entry = objs[i];
+            entry->data = data + done + i;
+            entry->high_priority = high_prio;
+            entry->executed = false;
+            tasklet_entry_init(entry, backend);
+            entry->reap_node.next = chain;
+            chain = &entry->reap_node;
+        }
+
+        spin_lock(&tasklet_list_lock);
+        for (i = 0; i < n; i++)
+            list_add_tail_rcu(&((tasklet_entry_t *)objs[i])->list, &active_tasklets);
+        spin_unlock(&tasklet_list_lock);
+
+        this_cpu_add(tasklet_stats.created, n);
+        this_cpu_add(tasklet_stats.scheduled, n);
+        if (high_prio)
+            this_cpu_add(tasklet_stats.high_prio, n);
+
+        if (cpu >= 0 && cpu_online(cpu)) {
+            target = cpu;
+        } else {
+            target = cpumask_next(target, cpu_online_mask);
+            if (target >= nr_cpu_ids)
+                target = cpumask_first(cpu_online_mask);
+        }
+        // No need to wait: the chain lives in the entries themselves and
+        // this CPU does not touch them again. tasklet_tracking_stop()
+        // waits for the count instead.
+        atomic_inc(&tasklet_chains_inflight);
+        smp_call_function_single(target, tasklet_schedule_chain, chain, 0);
+
+        done += n;
+    }
+    cpus_read_unlock();
+
+    defer_dbg("Ex6: Bulk scheduled %u tasklets (High Prio: %d)\n", done, high_prio);
+    return done;
+}
+
+// --- Tracking Start/Stop ---
+
+// Entries on active_tasklets, i.e. created and not yet reclaimed
+static unsigned long tasklet_count_live(void)
+{
+    tasklet_entry_t *entry;
+    unsigned long nr = 0;
+
+    rcu_read_lock();
+    list_for_each_entry_rcu(entry, &active_tasklets, list)
+        nr++;
+    rcu_read_unlock();
+    return nr;
+}
+
+// Stop reclaiming and free every tracked entry, run or not: pending ones
+// are killed first. Callers must have stopped creating entries. Returns
+// the number freed; they count as reclaimed.
+static unsigned long tasklet_tracking_stop(void)
+{
+    LLIST_HEAD(batch);
+    tasklet_entry_t *entry, *tmp;
+    unsigned long nr = 0;
+    int cpu;
+
+    // Bulk chains still being walked on their CPU, and entries still
+    // queued on an irq_work, must be scheduled before they can be killed
+    wait_var_event(&tasklet_chains_inflight, !atomic_read(&tasklet_chains_inflight));
+    tasklet_dispatcher_sync(&ex6_dispatch);
+
+    // Stop the reaper; everything still on the list is freed below
+    WRITE_ONCE(ex6_exiting, true);
+    cancel_delayed_work_sync(&tasklet_reaper);
+
+    // Kill every entry while it is still listed. Nothing else changes the
+    // list now, so the walk needs no lock and kill may sleep.
+    list_for_each_entry(entry, &active_tasklets, list) {
+        defer_dbg("Ex6: Killing tasklet (Data: %lu)\n", entry->data);
+        tasklet_entry_kill(entry);
+    }
+    // A handler that ran before it saw ex6_exiting may have re-armed the
+    // reaper; no handler can run any more, so this cancel is final
+    cancel_delayed_work_sync(&tasklet_reaper);
+
+    // No handler is using reap_node any more: drop the reap lists and
+    // unlink everything through it, as the reaper does
+    for_each_possible_cpu(cpu)
+        llist_del_all(per_cpu_ptr(&tasklet_reap, cpu));
+    spin_lock(&tasklet_list_lock);
+    list_for_each_entry_safe(entry, tmp, &active_tasklets, list) {
+        list_del_rcu(&entry->list);
+        llist_add(&entry->reap_node, &batch);
+    }
+    spin_unlock(&tasklet_list_lock);
+
+    // Proc readers may still see the entries
+    synchronize_rcu();
+
+    llist_for_each_entry_safe(entry, tmp, batch.first, reap_node) {
+        trace_defer_free(entry, entry->data, entry->high_priority);
+        kmem_cache_free(tasklet_cache, entry);
+        nr++;
+    }
+    WRITE_ONCE(tasklet_reclaimed, tasklet_reclaimed + nr);
+    return nr;
+}
+
+// Resume reclaiming (and publishing) after tasklet_tracking_stop()
+static void tasklet_tracking_start(void)
+{
+    WRITE_ONCE(ex6_exiting, false);
+    schedule_delayed_work(&tasklet_publisher, 0);
+}
+
+// --- Binary Stats Export ---
+
+static struct tasklet_stats_cpu *tasklet_export_slot(int cpu)
+{
+    struct tasklet_stats_hdr *hdr = tasklet_export;
+
+    return tasklet_export + hdr->hdr_size + (size_t)cpu * hdr->cpu_size;
+}
+
+static void tasklet_publish(void)
+{
+    struct tasklet_stats_hdr *hdr = tasklet_export;
+    struct tasklet_stats_cpu *slot;
+    struct tasklet_cpu_stats *stats;
+    int cpu, be, prio, i;
+
+    WRITE_ONCE(hdr->seq, hdr->seq + 1);
+    smp_wmb(); // Odd seq visible before any slot changes
+
+    for_each_possible_cpu(cpu) {
+        stats = per_cpu_ptr(&tasklet_stats, cpu);
+        slot = tasklet_export_slot(cpu);
+
+        slot->online = cpu_online(cpu);
+        slot->created = READ_ONCE(stats->created);
+        slot->scheduled = READ_ONCE(stats->scheduled);
+        slot->executed = READ_ONCE(stats->executed);
+        slot->high_prio = READ_ONCE(stats->high_prio);
+        for (be = 0; be < EX6_NR_BACKENDS; be++) {
+            slot->be_executed[be] = READ_ONCE(stats->be_executed[be]);
+            for (prio = 0; prio < TASKLET_NR_PRIO; prio++) {
+                slot->lat_max[be][prio] = READ_ONCE(stats->lat_max[be][prio]);
+                for (i = 0; i < TASKLET_LAT_BUCKETS; i++)
+                    slot->lat_hist[be][prio][i] = READ_ONCE(stats->lat_hist[be][prio][i]);
+            }
+        }
+    }
+    hdr->publish_ns = ktime_get_ns();
+    hdr->reclaimed = READ_ONCE(tasklet_reclaimed);
+
+    smp_wmb(); // Slots complete before seq turns even
+    WRITE_ONCE(hdr->seq, hdr->seq + 1);
+}
+
+static void tasklet_publish_fn(struct work_struct *work)
+{
+    unsigned int ms = READ_ONCE(publish_ms);
+
+    tasklet_publish();
+    // Deferrable: an idle system is not woken just to refresh the snapshot
+    if (ms && !READ_ONCE(ex6_exiting))
+        schedule_delayed_work(&tasklet_publisher, msecs_to_jiffies(ms));
+}
+
+static int tasklet_export_init(void)
+{
+    struct tasklet_stats_hdr *hdr;
+    size_t hdr_size = ALIGN(sizeof(*hdr), __alignof__(struct tasklet_stats_cpu));
+
+    BUILD_BUG_ON(TASKLET_LAT_BUCKETS != TASKLET_STATS_BUCKETS);
+    BUILD_BUG_ON(TASKLET_NR_PRIO != TASKLET_STATS_NR_PRIO);
+    BUILD_BUG_ON(EX6_NR_BACKENDS != TASKLET_STATS_NR_BACKENDS);
+
+    tasklet_export_size = PAGE_ALIGN(hdr_size +
+                                     nr_cpu_ids * sizeof(struct tasklet_stats_cpu));
+    tasklet_export = vmalloc_user(tasklet_export_size); // Zeroed, VM_USERMAP
+    if (!tasklet_export)
+        return -ENOMEM;
+
+    hdr = tasklet_export;
+    hdr->magic = TASKLET_STATS_MAGIC;
+    hdr->version = TASKLET_STATS_VERSION;
+    hdr->hdr_size = hdr_size;
+    hdr->cpu_size = sizeof(struct tasklet_stats_cpu);
+    hdr->nr_cpus = nr_cpu_ids;
+    return 0;
+}
+
+// The file is created with debugfs_create_file_unsafe(): the debugfs
+// proxy would hide .mmap. Each handler therefore pins the file itself so
+// ex6_exit cannot free the area underneath it.
+static int tasklet_export_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    int ret;
+
+    // Read-only snapshot; a writable mapping would let readers corrupt it
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+    vm_flags_clear(vma, VM_MAYWRITE);
+
+    ret = debugfs_file_get(file->f_path.dentry);
+    if (ret)
+        return ret;
+    ret = remap_vmalloc_range(vma, tasklet_export, vma->vm_pgoff);
+    debugfs_file_put(file->f_path.dentry);
+    return ret;
+}
+
+static ssize_t tasklet_export_read(struct file *file, char __user *ubuf,
+                                   size_t count, loff_t *ppos)
+{
+    ssize_t ret;
+
+    // Plain read() for tools that do not want to mmap; not seq-checked
+    ret = debugfs_file_get(file->f_path.dentry);
+    if (ret)
+        return ret;
+    ret = simple_read_from_buffer(ubuf, count, ppos, tasklet_export,
+                                  tasklet_export_size);
+    debugfs_file_put(file->f_path.dentry);
+    return ret;
+}
+
+static const struct file_operations tasklet_export_fops = {
+    .owner = THIS_MODULE,
+    .open = simple_open,
+    .read = tasklet_export_read,
+    .mmap = tasklet_export_mmap,
+    .llseek = default_llseek,
+};
+
 // --- Proc File Implementation ---
 
+static void tasklet_show_latency(struct seq_file *m, int be, int prio, const char *name)
+{
+    unsigned long hist[TASKLET_LAT_BUCKETS] = { 0 };
+    struct tasklet_cpu_stats *stats;
+    unsigned long count = 0;
+    u64 max = 0;
+    int cpu, i;
+
+    for_each_possible_cpu(cpu) {
+        stats = per_cpu_ptr(&tasklet_stats, cpu);
+        for (i = 0; i < TASKLET_LAT_BUCKETS; i++)
+            hist[i] += READ_ONCE(stats->lat_hist[be][prio][i]);
+        max = max(max, READ_ONCE(stats->lat_max[be][prio]));
+    }
+    for (i = 0; i < TASKLET_LAT_BUCKETS; i++)
+        count += hist[i];
+
+    seq_printf(m, "%-7s %-6s count %lu p50 <%llu p99 <%llu p99.9 <%llu max %llu\n",
+               ex6_backend_names[be], name, count,
+               defer_hist_percentile(hist, TASKLET_LAT_BUCKETS, count, 5000),
+               defer_hist_percentile(hist, TASKLET_LAT_BUCKETS, count, 9900),
+               defer_hist_percentile(hist, TASKLET_LAT_BUCKETS, count, 9990), max);
+}
+
+// Clear the latency histograms and per-backend execution counts, starting
+// a new measurement window. A handler recording on another CPU at the
+// same time may leave a sample behind, which is acceptable for a reset.
+static void tasklet_reset_latency(void)
+{
+    struct tasklet_cpu_stats *stats;
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        stats = per_cpu_ptr(&tasklet_stats, cpu);
+        memset(stats->lat_hist, 0, sizeof(stats->lat_hist));
+        memset(stats->lat_max, 0, sizeof(stats->lat_max));
+        memset(stats->be_executed, 0, sizeof(stats->be_executed));
+    }
+}
+
 static int tasklet_stats_show(struct seq_file *m, void *v)
 {
-    unsigned long flags;
+    struct tasklet_cpu_stats total = { 0 }, *stats;
     int current_pending = 0;
+    unsigned long be_executed[EX6_NR_BACKENDS] = { 0 };
     tasklet_entry_t *entry;
+    int cpu, be;
 
     // Recalculate pending based on list traversal (more accurate than counter alone)
-    spin_lock_irqsave(&tasklet_list_lock, flags);
-    list_for_each_entry(entry, &active_tasklets, list) {
+    // Lock-free walk: neither creators nor handlers wait for us
+    rcu_read_lock();
+    list_for_each_entry_rcu(entry, &active_tasklets, list) {
         // Check tasklet state (TASKLET_STATE_SCHED bit)
         // This is a bit hacky/internal, simpler to rely on our executed flag
         // if (test_bit(TASKLET_STATE_SCHED, &entry->tasklet.state)) {
         //     current_pending++;
         // }
-        if (!entry->executed && test_bit(TASKLET_STATE_SCHED, &entry->tasklet.state)) {
+        if (!READ_ONCE(entry->executed) &&
+            tasklet_entry_pending(entry)) {
              current_pending++;
         }
     }
-    spin_unlock_irqrestore(&tasklet_list_lock, flags);
+    rcu_read_unlock();
+
+    // Sum the per-CPU counters
+    for_each_possible_cpu(cpu) {
+        stats = per_cpu_ptr(&tasklet_stats, cpu);
+        total.created += READ_ONCE(stats->created);
+        total.scheduled += READ_ONCE(stats->scheduled);
+        total.executed += READ_ONCE(stats->executed);
+        total.high_prio += READ_ONCE(stats->high_prio);
+        for (be = 0; be < EX6_NR_BACKENDS; be++)
+            be_executed[be] += READ_ONCE(stats->be_executed[be]);
+    }
 
     // Use seq_printf for output
     seq_printf(m, "--- Tasklet Statistics ---\n");
-    seq_printf(m, "Created:       %d\n", atomic_read(&created_count));
-    seq_printf(m, "Scheduled:     %d\n", atomic_read(&scheduled_count));
-    seq_printf(m, "Executed:      %d\n", atomic_read(&executed_count));
-    seq_printf(m, "High Priority: %d\n", atomic_read(&high_prio_count));
-    //seq_printf(m, "Currently Pending (Counter): %d\n", atomic_read(&pending_count));
+    seq_printf(m, "Created:       %lu\n", total.created);
+    seq_printf(m, "Scheduled:     %lu\n", total.scheduled);
+    seq_printf(m, "Executed:      %lu\n", total.executed);
+    seq_printf(m, "High Priority: %lu\n", total.high_prio);
+    seq_printf(m, "Currently Pending (Counter): %ld\n",
+               (long)(total.scheduled - total.executed));
     seq_printf(m, "Currently Pending (Scan):    %d\n", current_pending);
+    // Lifetime totals above keep counting; only the memory is recycled
+    seq_printf(m, "Reclaimed:     %lu\n", READ_ONCE(tasklet_reclaimed));
+    seq_printf(m, "Live Entries:  %ld\n",
+               (long)(total.created - READ_ONCE(tasklet_reclaimed)));
+
+    // Per-CPU breakdown: where tasklets were created and where they ran
+    seq_printf(m, "--- Per-CPU ---\n");
+    for_each_online_cpu(cpu) {
+        stats = per_cpu_ptr(&tasklet_stats, cpu);
+        seq_printf(m, "cpu%-3d created %lu scheduled %lu executed %lu high %lu\n", cpu,
+                   READ_ONCE(stats->created), READ_ONCE(stats->scheduled),
+                   READ_ONCE(stats->executed), READ_ONCE(stats->high_prio));
+    }
+
+    // Backend comparison: executions since the last reset, then latency.
+    // Run the same generator load with backend=tasklet and backend=bh to
+    // compare throughput and dispatch latency side by side.
+    seq_printf(m, "--- Backends (default %s) ---\n",
+               ex6_backend_names[READ_ONCE(ex6_backend)]);
+    for (be = 0; be < EX6_NR_BACKENDS; be++)
+        seq_printf(m, "%-7s executed %lu\n", ex6_backend_names[be], be_executed[be]);
+
+    seq_printf(m, "--- Latency (schedule->execute, ns) ---\n");
+    for (be = 0; be < EX6_NR_BACKENDS; be++) {
+        tasklet_show_latency(m, be, TASKLET_PRIO_HIGH, "high");
+        tasklet_show_latency(m, be, TASKLET_PRIO_NORMAL, "normal");
+    }
+    tasklet_dispatch_show(m, &ex6_dispatch);
 
     return 0;
 }
 
+// Writing "reset" starts a new measurement window (see tasklet_reset_latency)
+static ssize_t tasklet_stats_write(struct file *file, const char __user *ubuf,
+                                   size_t count, loff_t *ppos)
+{
+    char buf[16];
+
+    if (count >= sizeof(buf))
+        return -EINVAL;
+    if (copy_from_user(buf, ubuf, count))
+        return -EFAULT;
+    buf[count] = '\0';
+
+    if (!sysfs_streq(buf, "reset"))
+        return -EINVAL;
+
+    tasklet_reset_latency();
+    return count;
+}
+
 // Boilerplate for single proc file read
 static int tasklet_stats_open(struct inode *inode, struct file *file)
 {
@@ -143,6 +816,235 @@ static const struct proc_ops tasklet_stats_fops = {
     .proc_read = seq_read,
     .proc_lseek = seq_lseek,
     .proc_release = single_release,
+    .proc_write = tasklet_stats_write,
+};
+
+// --- Load Generator ---
+//
+// /proc/tasklet_ctl accepts
+//     spawn N [prio=hi|normal] [cpu=X] [rate=R] [duration=S] [backend=tasklet|bh]
+//     stop
+// "spawn" starts a kthread that creates N tasklets (0 = unlimited) through
+// create_and_schedule_tasklets(), at most R per second (0 = as fast as
+// possible), for at most S seconds (0 = no limit; N and S cannot both be
+// 0). cpu=X sends all of them to CPU X, otherwise they are spread across
+// the online CPUs. backend= overrides the backend module parameter for
+// this generator. "stop" stops every generator. Reading the file lists
+// the generators; finished ones stay listed until the next spawn or stop.
+
+struct tasklet_gen {
+    struct list_head node;
+    struct task_struct *task;
+    unsigned int id;
+    unsigned int nr;       // Tasklets to create, 0 = unlimited
+    unsigned int rate;     // Per second, 0 = unthrottled
+    unsigned int duration; // Seconds, 0 = unlimited
+    int cpu;               // Target CPU, -1 = spread
+    bool high_prio;
+    int backend;           // EX6_BACKEND_*
+    unsigned long created;
+    bool done;
+};
+
+static LIST_HEAD(tasklet_gens);
+static DEFINE_MUTEX(tasklet_gen_lock); // Protects tasklet_gens
+static unsigned int tasklet_nr_gens;
+static unsigned int tasklet_gen_next_id;
+
+static int tasklet_gen_fn(void *arg)
+{
+    struct tasklet_gen *gen = arg;
+    u64 start = ktime_get_ns(), now, due;
+    u64 end = gen->duration ? start + (u64)gen->duration * NSEC_PER_SEC : 0;
+    unsigned long base = (unsigned long)gen->id * 1000000;
+    unsigned int want, got;
+
+    while (!kthread_should_stop()) {
+        now = ktime_get_ns();
+        if (end && now >= end)
+            break;
+        if (gen->nr && gen->created >= gen->nr)
+            break;
+
+        want = TASKLET_BULK_CHUNK;
+        if (gen->rate) {
+            // Catch up to where the rate says we should be, one chunk at most
+            due = mul_u64_u32_div(now - start, gen->rate, NSEC_PER_SEC);
+            want = due > gen->created ? min_t(u64, due - gen->created, want) : 0;
+        }
+        if (gen->nr)
+            want = min_t(unsigned long, want, gen->nr - gen->created);
+
+        if (want) {
+            got = create_and_schedule_tasklets(want, base + gen->created,
+                                               gen->high_prio, gen->cpu, gen->backend);
+            WRITE_ONCE(gen->created, gen->created + got);
+            if (!got)
+                break; // Out of memory, give up
+        }
+
+        if (gen->rate)
+            usleep_range(500, 1000);
+        else
+            cond_resched();
+    }
+
+    // Park until stopped so the owner can always kthread_stop() us
+    WRITE_ONCE(gen->done, true);
+    while (!kthread_should_stop()) {
+        set_current_state(TASK_INTERRUPTIBLE);
+        if (!kthread_should_stop())
+            schedule();
+        __set_current_state(TASK_RUNNING);
+    }
+    return 0;
+}
+
+// Stop generators; with only_done, just the ones that have finished.
+// Called with tasklet_gen_lock held.
+static void tasklet_gen_stop(bool only_done)
+{
+    struct tasklet_gen *gen, *tmp;
+
+    list_for_each_entry_safe(gen, tmp, &tasklet_gens, node) {
+        if (only_done && !READ_ONCE(gen->done))
+            continue;
+        kthread_stop(gen->task);
+        list_del(&gen->node);
+        tasklet_nr_gens--;
+        kfree(gen);
+    }
+}
+
+static int tasklet_gen_spawn(char *args)
+{
+    struct tasklet_gen *gen;
+    char *tok, *val;
+    int ret;
+
+    gen = kzalloc(sizeof(*gen), GFP_KERNEL);
+    if (!gen)
+        return -ENOMEM;
+    gen->cpu = -1;
+    gen->backend = READ_ONCE(ex6_backend);
+
+    tok = strsep(&args, " \t");
+    ret = tok ? kstrtouint(tok, 0, &gen->nr) : -EINVAL;
+    while (!ret && (tok = strsep(&args, " \t"))) {
+        if (!*tok)
+            continue;
+        val = strchr(tok, '=');
+        if (!val) {
+            ret = -EINVAL;
+            break;
+        }
+        *val++ = '\0';
+        if (!strcmp(tok, "prio")) {
+            if (!strcmp(val, "hi") || !strcmp(val, "high"))
+                gen->high_prio = true;
+            else if (strcmp(val, "normal"))
+                ret = -EINVAL;
+        } else if (!strcmp(tok, "cpu")) {
+            ret = kstrtoint(val, 0, &gen->cpu);
+            if (!ret && (gen->cpu < 0 || gen->cpu >= nr_cpu_ids || !cpu_possible(gen->cpu)))
+                ret = -EINVAL;
+        } else if (!strcmp(tok, "rate")) {
+            ret = kstrtouint(val, 0, &gen->rate);
+        } else if (!strcmp(tok, "duration")) {
+            ret = kstrtouint(val, 0, &gen->duration);
+        } else if (!strcmp(tok, "backend")) {
+            gen->backend = ex6_backend_parse(val);
+            ret = gen->backend < 0 ? gen->backend : 0;
+        } else {
+            ret = -EINVAL;
+        }
+    }
+    if (!ret && !gen->nr && !gen->duration)
+        ret = -EINVAL; // Would never end on its own
+    if (ret)
+        goto err;
+
+    mutex_lock(&tasklet_gen_lock);
+    tasklet_gen_stop(true); // Reap finished generators first
+    if (tasklet_nr_gens >= TASKLET_MAX_GENERATORS) {
+        ret = -EBUSY;
+        goto unlock;
+    }
+    gen->id = tasklet_gen_next_id++;
+    gen->task = kthread_run(tasklet_gen_fn, gen, "ex6_gen/%u", gen->id);
+    if (IS_ERR(gen->task)) {
+        ret = PTR_ERR(gen->task);
+        goto unlock;
+    }
+    list_add_tail(&gen->node, &tasklet_gens);
+    tasklet_nr_gens++;
+    pr_info("Ex6: Generator %u started (nr %u prio %s cpu %d rate %u duration %u backend %s)\n",
+            gen->id, gen->nr, gen->high_prio ? "hi" : "normal", gen->cpu,
+            gen->rate, gen->duration, ex6_backend_names[gen->backend]);
+    mutex_unlock(&tasklet_gen_lock);
+    return 0;
+
+unlock:
+    mutex_unlock(&tasklet_gen_lock);
+err:
+    kfree(gen);
+    return ret;
+}
+
+static int tasklet_ctl_show(struct seq_file *m, void *v)
+{
+    struct tasklet_gen *gen;
+
+    mutex_lock(&tasklet_gen_lock);
+    list_for_each_entry(gen, &tasklet_gens, node) {
+        seq_printf(m, "gen%-3u %-7s created %lu nr %u prio %s cpu %d rate %u duration %u backend %s\n",
+                   gen->id, READ_ONCE(gen->done) ? "done" : "running",
+                   READ_ONCE(gen->created), gen->nr,
+                   gen->high_prio ? "hi" : "normal", gen->cpu, gen->rate, gen->duration,
+                   ex6_backend_names[gen->backend]);
+    }
+    mutex_unlock(&tasklet_gen_lock);
+    return 0;
+}
+
+static ssize_t tasklet_ctl_write(struct file *file, const char __user *ubuf,
+                                 size_t count, loff_t *ppos)
+{
+    char buf[128], *cmd, *args;
+    int ret;
+
+    if (count >= sizeof(buf))
+        return -EINVAL;
+    if (copy_from_user(buf, ubuf, count))
+        return -EFAULT;
+    buf[count] = '\0';
+
+    args = strim(buf);
+    cmd = strsep(&args, " \t");
+    if (!strcmp(cmd, "spawn") && args) {
+        ret = tasklet_gen_spawn(args);
+    } else if (!strcmp(cmd, "stop") && !args) {
+        mutex_lock(&tasklet_gen_lock);
+        tasklet_gen_stop(false);
+        mutex_unlock(&tasklet_gen_lock);
+        ret = 0;
+    } else {
+        ret = -EINVAL;
+    }
+    return ret ? ret : count;
+}
+
+static int tasklet_ctl_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, tasklet_ctl_show, NULL);
+}
+
+static const struct proc_ops tasklet_ctl_fops = {
+    .proc_open = tasklet_ctl_open,
+    .proc_read = seq_read,
+    .proc_lseek = seq_lseek,
+    .proc_release = single_release,
+    .proc_write = tasklet_ctl_write,
 };
 
 // --- Module Init/Exit ---
@@ -150,6 +1052,7 @@ static const struct proc_ops tasklet_stats_fops = {
 static int __init ex6_init(void)
 {
     struct proc_dir_entry *proc_entry;
+    struct dentry *export_file;
 
     pr_info("Ex6 Module: Loading...\n");
 
@@ -164,20 +1067,50 @@ static int __init ex6_init(void)
         return -ENOMEM;
     }
     pr_info("Ex6: Slab cache created.\n");
+    if (tasklet_dispatcher_init(&ex6_dispatch)) {
+        pr_err("Ex6: Failed to register the dispatcher's CPU hotplug state.\n");
+        kmem_cache_destroy(tasklet_cache);
+        return -ENOMEM;
+    }
+
+    // Binary stats export, published to debugfs ex6/stats.bin
+    if (tasklet_export_init()) {
+        pr_err("Ex6: Failed to allocate binary stats area.\n");
+        tasklet_dispatcher_destroy(&ex6_dispatch);
+        kmem_cache_destroy(tasklet_cache);
+        return -ENOMEM;
+    }
+    ex6_debugfs_dir = debugfs_create_dir("ex6", NULL);
+    // Unsafe (unproxied) so mmap() reaches tasklet_export_mmap
+    export_file = debugfs_create_file_unsafe("stats.bin", 0444, ex6_debugfs_dir, NULL,
+                                             &tasklet_export_fops);
+    if (!IS_ERR(export_file))
+        i_size_write(d_inode(export_file), tasklet_export_size);
+    schedule_delayed_work(&tasklet_publisher, 0);
 
     // Create /proc entry
-    proc_entry = proc_create(PROC_FILENAME, 0444, NULL, &tasklet_stats_fops); // Read-only for all
+    proc_entry = proc_create(PROC_FILENAME, 0644, NULL, &tasklet_stats_fops); // Root may write "reset"
     if (!proc_entry) {
         pr_err("Ex6: Failed to create /proc/%s entry.\n", PROC_FILENAME);
+        debugfs_remove_recursive(ex6_debugfs_dir);
+        cancel_delayed_work_sync(&tasklet_publisher);
+        vfree(tasklet_export);
+        tasklet_dispatcher_destroy(&ex6_dispatch);
         kmem_cache_destroy(tasklet_cache); // Clean up cache
         return -ENOMEM;
     }
     pr_info("Ex6: /proc/%s entry created.\n", PROC_FILENAME);
 
+    // Control file for the load generator; root only
+    if (!proc_create(PROC_CTL_FILENAME, 0600, NULL, &tasklet_ctl_fops))
+        pr_warn("Ex6: Failed to create /proc/%s, load generator unavailable.\n",
+                PROC_CTL_FILENAME);
+
     // Create some tasklets for testing
     create_and_schedule_tasklet(100, false); // Normal prio
     create_and_schedule_tasklet(200, true);  // High prio
     create_and_schedule_tasklet(300, false); // Normal prio
+    create_and_schedule_tasklets(64, 1000, false, -1, ex6_backend); // Burst spread over CPUs
 
     pr_info("Ex6 Module: Loaded successfully.\n");
     return 0;
@@ -185,33 +1118,34 @@ static int __init ex6_init(void)
 
 static void __exit ex6_exit(void)
 {
-    struct list_head *pos, *n;
-    tasklet_entry_t *entry;
-    unsigned long flags;
+    unsigned long nr;
 
     pr_info("Ex6 Module: Exiting...\n");
 
-    // Remove /proc entry first
+    // Remove /proc entries first, then stop the load generators so no
+    // new tasklets appear while we tear down
+    remove_proc_entry(PROC_CTL_FILENAME, NULL);
     remove_proc_entry(PROC_FILENAME, NULL);
     pr_info("Ex6: /proc/%s entry removed.\n", PROC_FILENAME);
+    mutex_lock(&tasklet_gen_lock);
+    tasklet_gen_stop(false);
+    mutex_unlock(&tasklet_gen_lock);
 
-    // Kill and free all active tasklets
+    // Kill and free all active tasklets. This also stops the reaper, and
+    // the publisher no longer re-arms itself.
     pr_info("Ex6: Cleaning up tasklets...\n");
-    spin_lock_irqsave(&tasklet_list_lock, flags);
-    list_for_each_safe(pos, n, &active_tasklets) {
-        entry = list_entry(pos, tasklet_entry_t, list);
-        list_del(&entry->list); // Remove from list *before* killing
-
-        pr_info("Ex6: Killing tasklet (Data: %lu)\n", entry->data);
-        // Unlock before kill, as kill might sleep
-        spin_unlock_irqrestore(&tasklet_list_lock, flags);
-        tasklet_kill(&entry->tasklet);
-        kmem_cache_free(tasklet_cache, entry);
-        spin_lock_irqsave(&tasklet_list_lock, flags); // Relock for next iteration
-    }
-    spin_unlock_irqrestore(&tasklet_list_lock, flags);
-    pr_info("Ex6: Tasklet cleanup complete.\n");
+    nr = tasklet_tracking_stop();
+    pr_info("Ex6: Tasklet cleanup complete (%lu entries freed).\n", nr);
 
+    // Drop the binary export. Existing mappings keep their own page
+    // references, so vfree() is safe even if a collector still has it mapped.
+    debugfs_remove_recursive(ex6_debugfs_dir);
+    // A publish_ms write that missed ex6_exiting has re-armed by now
+    kernel_param_lock(THIS_MODULE);
+    kernel_param_unlock(THIS_MODULE);
+    cancel_delayed_work_sync(&tasklet_publisher);
+    vfree(tasklet_export);
+    tasklet_dispatcher_destroy(&ex6_dispatch);
 
     // Destroy slab cache (must be done after all objects freed)
     if (tasklet_cache) {
@@ -228,4 +1162,8 @@ module_exit(ex6_exit);
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Oliver Jędrzejczyk");
 MODULE_DESCRIPTION("Exercise 6: Tasklet stats in /proc using slab");
-MODULE_VERSION("1.0");
\ No newline at end of file
+MODULE_VERSION("1.0");
+
+#if IS_ENABLED(CONFIG_OSLAB_DEFER_KUNIT_TEST)
+#include "ex6_test.c" // KUnit suite; uses the static functions above
+#endif
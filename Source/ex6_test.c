@@ -0,0 +1,226 @@
+// KUnit suite for the ex6 tasklet tracker. Built into ex6.o (ex6.c
+// includes this file when CONFIG_OSLAB_DEFER_KUNIT_TEST is set) so it can
+// reach the static tracking functions; run it with kunit.py, see Kbuild.
+//
+// Correctness: bulk-created entries run in creation order on their CPU;
+// every entry is reclaimed once it has run; tasklet_tracking_stop() frees
+// entries that are still queued, including ones a cross-CPU bulk call is
+// still scheduling. Timing: create cost per entry for the single and bulk
+// paths, and drain time, checked against the budgets when those are set
+// (ex6.kunit_create_budget_ns=..., see defer_test.h).
+
+#include "defer_test.h"     // Shared fixture, kunit_drain_budget_ns
+
+static unsigned int kunit_create_budget_ns;
+module_param(kunit_create_budget_ns, uint, 0644);
+MODULE_PARM_DESC(kunit_create_budget_ns, "KUnit: fail if creating an entry costs more than this (ns, 0 = report only)");
+
+#define TASKLET_TEST_ENTRIES 256
+#define TASKLET_BENCH_ENTRIES 4096
+#define TASKLET_TEST_DATA    0x7e570000UL // Data of the first test entry, key 0
+
+// What the handler hook saw; entries outside the test data range are ignored
+static struct defer_test_ctx *tasklet_test_ctx;
+
+static void tasklet_test_record(tasklet_entry_t *entry)
+{
+    struct defer_test_ctx *ctx = READ_ONCE(tasklet_test_ctx);
+
+    if (ctx && entry->data - TASKLET_TEST_DATA < ctx->nr)
+        defer_test_record(ctx, entry->data - TASKLET_TEST_DATA);
+}
+
+static struct defer_test_ctx *tasklet_test_ctx_alloc(struct kunit *test, unsigned int nr)
+{
+    struct defer_test_ctx *ctx;
+
+    ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, ctx);
+    defer_test_ctx_init(test, ctx, nr);
+
+    WRITE_ONCE(tasklet_test_ctx, ctx);
+    return ctx;
+}
+
+// Wait until the reaper has freed every tracked entry
+static bool tasklet_test_wait_reaped(void)
+{
+    unsigned long deadline = jiffies + DEFER_TEST_TIMEOUT;
+
+    while (tasklet_count_live()) {
+        if (time_after(jiffies, deadline))
+            return false;
+        msleep(max(reap_ms, 1U));
+    }
+    return true;
+}
+
+// Create nr entries on the current CPU with the bulk API
+static unsigned int tasklet_test_create_local(unsigned int nr, int backend)
+{
+    // Only a target: if the CPU goes offline the chunks move on
+    return create_and_schedule_tasklets(nr, TASKLET_TEST_DATA, false,
+                                        raw_smp_processor_id(), backend);
+}
+
+static void tasklet_test_bulk_order(struct kunit *test, int backend)
+{
+    struct defer_test_ctx *ctx = tasklet_test_ctx_alloc(test, TASKLET_TEST_ENTRIES);
+
+    KUNIT_ASSERT_EQ(test, tasklet_test_create_local(ctx->nr, backend), ctx->nr);
+    if (defer_test_wait(test, ctx))
+        defer_test_check_order(test, ctx);
+}
+
+static void tasklet_test_order_tasklet(struct kunit *test)
+{
+    tasklet_test_bulk_order(test, EX6_BACKEND_TASKLET);
+}
+
+// Entries that have run are all reclaimed, and nothing stays tracked
+static void tasklet_test_reclaim(struct kunit *test)
+{
+    struct defer_test_ctx *ctx = tasklet_test_ctx_alloc(test, TASKLET_TEST_ENTRIES);
+    unsigned long reclaimed = READ_ONCE(tasklet_reclaimed);
+    unsigned int i;
+
+    for (i = 0; i < ctx->nr / 2; i++)
+        KUNIT_ASSERT_NOT_NULL(test, create_and_schedule_tasklet(TASKLET_TEST_DATA + i, i & 1));
+    KUNIT_ASSERT_EQ(test, create_and_schedule_tasklets(ctx->nr - i, TASKLET_TEST_DATA + i,
+                                                       false, -1, READ_ONCE(ex6_backend)),
+                    ctx->nr - i);
+
+    KUNIT_ASSERT_TRUE(test, defer_test_wait(test, ctx));
+    KUNIT_EXPECT_TRUE(test, tasklet_test_wait_reaped());
+    KUNIT_EXPECT_EQ(test, READ_ONCE(tasklet_reclaimed) - reclaimed, (unsigned long)ctx->nr);
+    KUNIT_EXPECT_EQ(test, tasklet_count_live(), 0UL);
+}
+
+// Stopping with entries still queued frees all of them, run or not. With
+// remote set they are bulk-created on another CPU, so the stop can race
+// with the cross-CPU call that schedules them.
+static void tasklet_test_stop(struct kunit *test, int backend, bool remote)
+{
+    unsigned long reclaimed = READ_ONCE(tasklet_reclaimed);
+    unsigned int nr, saved_reap_ms = READ_ONCE(reap_ms);
+    int cpu = -1;
+
+    if (remote) {
+        cpu = cpumask_any_but(cpu_online_mask, raw_smp_processor_id());
+        if (cpu >= nr_cpu_ids)
+            kunit_skip(test, "needs a second online CPU");
+    }
+
+    // Entries that run before the stop must still be there for it to free:
+    // hold the reaper off. The tracking list is empty (see the suite init),
+    // so no reaper run is due and the first handler arms it with this delay.
+    WRITE_ONCE(reap_ms, 60 * MSEC_PER_SEC);
+    cancel_delayed_work_sync(&tasklet_reaper);
+
+    if (remote)
+        nr = create_and_schedule_tasklets(TASKLET_TEST_ENTRIES, TASKLET_TEST_DATA, false,
+                                          cpu, backend);
+    else
+        nr = tasklet_test_create_local(TASKLET_TEST_ENTRIES, backend);
+    KUNIT_EXPECT_EQ(test, nr, TASKLET_TEST_ENTRIES);
+
+    KUNIT_EXPECT_EQ(test, tasklet_tracking_stop(), (unsigned long)nr);
+    WRITE_ONCE(reap_ms, saved_reap_ms);
+    tasklet_tracking_start();
+
+    KUNIT_EXPECT_EQ(test, READ_ONCE(tasklet_reclaimed) - reclaimed, (unsigned long)nr);
+    KUNIT_EXPECT_EQ(test, tasklet_count_live(), 0UL);
+    KUNIT_EXPECT_TRUE(test, list_empty(&active_tasklets));
+}
+
+static void tasklet_test_stop_tasklet(struct kunit *test)
+{
+    tasklet_test_stop(test, EX6_BACKEND_TASKLET, false);
+}
+
+static void tasklet_test_stop_remote(struct kunit *test)
+{
+    tasklet_test_stop(test, EX6_BACKEND_TASKLET, true);
+}
+
+#ifdef EX6_HAVE_BH_WQ
+static void tasklet_test_order_bh(struct kunit *test)
+{
+    tasklet_test_bulk_order(test, EX6_BACKEND_BH);
+}
+
+static void tasklet_test_stop_bh(struct kunit *test)
+{
+    tasklet_test_stop(test, EX6_BACKEND_BH, false);
+}
+#endif
+
+// Create cost per entry and drain time per entry, single and bulk API
+static void tasklet_bench_create_drain(struct kunit *test)
+{
+    struct defer_test_ctx *ctx;
+    unsigned int i, bulk;
+    char what[32];
+    u64 t0, t1;
+
+    for (bulk = 0; bulk < 2; bulk++) {
+        ctx = tasklet_test_ctx_alloc(test, TASKLET_BENCH_ENTRIES);
+
+        t0 = ktime_get_ns();
+        if (bulk) {
+            create_and_schedule_tasklets(ctx->nr, TASKLET_TEST_DATA, false, -1,
+                                         READ_ONCE(ex6_backend));
+        } else {
+            for (i = 0; i < ctx->nr; i++)
+                create_and_schedule_tasklet(TASKLET_TEST_DATA + i, false);
+        }
+        t1 = ktime_get_ns();
+        KUNIT_ASSERT_TRUE(test, defer_test_wait(test, ctx));
+
+        snprintf(what, sizeof(what), "%s %s", bulk ? "bulk" : "single",
+                 ex6_backend_names[READ_ONCE(ex6_backend)]);
+        defer_test_report(test, ctx, what, t0, t1, kunit_create_budget_ns);
+
+        WRITE_ONCE(tasklet_test_ctx, NULL);
+        KUNIT_EXPECT_TRUE(test, tasklet_test_wait_reaped());
+    }
+}
+
+static int tasklet_test_init(struct kunit *test)
+{
+    // Start from an empty tracking list (e.g. the entries ex6_init made)
+    if (!tasklet_test_wait_reaped())
+        return -ETIMEDOUT;
+    WRITE_ONCE(tasklet_test_hook, tasklet_test_record);
+    return 0;
+}
+
+static void tasklet_test_exit(struct kunit *test)
+{
+    WRITE_ONCE(tasklet_test_hook, NULL);
+    WRITE_ONCE(tasklet_test_ctx, NULL);
+    // Nothing may still run against the kunit-managed ctx once it is freed
+    tasklet_dispatcher_sync(&ex6_dispatch);
+    synchronize_rcu();
+}
+
+static struct kunit_case tasklet_test_cases[] = {
+    KUNIT_CASE(tasklet_test_order_tasklet),
+    KUNIT_CASE(tasklet_test_reclaim),
+    KUNIT_CASE(tasklet_test_stop_tasklet),
+    KUNIT_CASE(tasklet_test_stop_remote),
+#ifdef EX6_HAVE_BH_WQ
+    KUNIT_CASE(tasklet_test_order_bh),
+    KUNIT_CASE(tasklet_test_stop_bh),
+#endif
+    KUNIT_CASE_SLOW(tasklet_bench_create_drain),
+    {}
+};
+
+static struct kunit_suite tasklet_test_suite = {
+    .name = "ex6_tasklet",
+    .init = tasklet_test_init,
+    .exit = tasklet_test_exit,
+    .test_cases = tasklet_test_cases,
+};
+kunit_test_suite(tasklet_test_suite);
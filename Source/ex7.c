@@ -4,29 +4,290 @@
 #include <linux/printk.h>    // pr_info
 #include <linux/jiffies.h>   // HZ
 #include <linux/slab.h>      // kmalloc/kfree (if needed for data)
+#include <linux/mm.h>        // kvcalloc
+#include <linux/ktime.h>     // ktime_get_ns
+#include <linux/math64.h>    // div64_u64
+#include <linux/mutex.h>     // Serialises benchmark runs
+#include <linux/debugfs.h>   // Benchmark control and results
+#include <linux/seq_file.h>  // results.csv
+#include <linux/string.h>    // strcmp, memset
+#include <linux/preempt.h>   // migrate_disable
+#include "defer_log.h"       // defer_dbg, verbose parameter
+#include "defer_stats.h"     // Latency percentiles
+#include "defer_run.h"       // debugfs "run" trigger
+
+#define DEFER_TRACE_SYSTEM ex7
+#define CREATE_TRACE_POINTS
+#include "defer_trace.h"     // defer_schedule/start/end/free events
+
+DEFINE_DEFER_VERBOSE();
 
 // Handlers are the same as Listing 2 / Exercise 5
 static void normal_work_handler(struct work_struct *work)
 {
-    pr_info("Ex7 Normal Work Handler: Hi! I'm handler of normal work!\n");
+    trace_defer_start(work, 0, false);
+    defer_dbg("Ex7 Normal Work Handler: Hi! I'm handler of normal work!\n");
+    trace_defer_end(work, 0, false);
 }
 
 static void delayed_work_handler(struct work_struct *work)
 {
-    pr_info("Ex7 Delayed Work Handler: Hi! I'm handler of delayed work!\n");
+    trace_defer_start(work, 1, false);
+    defer_dbg("Ex7 Delayed Work Handler: Hi! I'm handler of delayed work!\n");
+    trace_defer_end(work, 1, false);
 }
 
 // Declare work items statically
 static DECLARE_WORK(normal_work, normal_work_handler);
 static DECLARE_DELAYED_WORK(delayed_work, delayed_work_handler);
 
+// --- Workqueue flavor benchmark ---
+//
+// Pushes bench_items work items through each workqueue flavor below, once
+// per bench_max_active value for the flavors where max_active matters,
+// and records for every run the queue-to-start latency percentiles, the
+// throughput and how the items spread over CPUs. All items are queued
+// from one CPU (the writer is kept from migrating during the loop) with
+// queue_work(), so the CPU spread shows where each flavor actually runs
+// work submitted from one place.
+//
+// Start a run with "echo run > /sys/kernel/debug/ex7/run"; the write
+// returns when the whole matrix is done. Results of the last run are in
+// /sys/kernel/debug/ex7/results.csv, one line per queue:
+//     flavor,flags,max_active,items,p50_ns,p90_ns,p99_ns,max_ns,elapsed_ns,items_per_sec,cpus,max_cpu_pct
+// max_active 0 means the workqueue default; max_cpu_pct is the share of
+// items that ran on the busiest CPU.
+
+static unsigned int bench_items = 10000;
+module_param(bench_items, uint, 0644);
+MODULE_PARM_DESC(bench_items, "Work items pushed through each benchmarked queue");
+
+static unsigned int bench_work_ns;
+module_param(bench_work_ns, uint, 0644);
+MODULE_PARM_DESC(bench_work_ns, "Busy time per benchmark work item (ns)");
+
+static int bench_max_active[8] = { 1, 4, 16, 0 };
+static int bench_nr_max_active = 4;
+module_param_array_named(bench_max_active, bench_max_active, int, &bench_nr_max_active, 0444);
+MODULE_PARM_DESC(bench_max_active, "max_active values to benchmark (0 = default, at most WQ_MAX_ACTIVE), comma separated");
+
+#define EX7_BENCH_MAX_ITEMS (1U << 20)
+
+struct ex7_bench_flavor {
+    const char *name;
+    unsigned int flags;
+    bool fixed;    // Runs once, max_active does not apply
+};
+
+static const struct ex7_bench_flavor ex7_bench_flavors[] = {
+    { "system", 0, true },           // system_wq, nothing allocated
+    { "bound", 0, false },
+    { "unbound", WQ_UNBOUND, false },
+    { "highpri", WQ_HIGHPRI, false },
+    { "cpu_intensive", WQ_CPU_INTENSIVE, false },
+    { "ordered", WQ_UNBOUND, true }, // alloc_ordered_workqueue()
+};
+
+struct ex7_bench_item {
+    struct work_struct work;
+    u64 queued_ns;
+    u64 start_ns;
+    u64 end_ns;
+    int cpu;
+};
+
+struct ex7_bench_result {
+    const char *flavor;
+    unsigned int flags;
+    int max_active;
+    unsigned int items;
+    u64 p50_ns, p90_ns, p99_ns, max_ns;
+    u64 elapsed_ns;
+    u64 per_sec;
+    unsigned int cpus;
+    unsigned int max_cpu_pct;
+};
+
+static DEFINE_MUTEX(ex7_bench_lock); // Protects the results and the buffers below
+static struct ex7_bench_result ex7_bench_results[ARRAY_SIZE(ex7_bench_flavors) * ARRAY_SIZE(bench_max_active)];
+static unsigned int ex7_bench_nr_results;
+static struct dentry *ex7_debugfs_dir;
+
+static void ex7_bench_fn(struct work_struct *work)
+{
+    struct ex7_bench_item *item = container_of(work, struct ex7_bench_item, work);
+    u64 now = ktime_get_ns();
+
+    item->start_ns = now;
+    item->cpu = raw_smp_processor_id();
+    if (bench_work_ns) {
+        while (ktime_get_ns() - now < bench_work_ns)
+            cpu_relax();
+    }
+    item->end_ns = ktime_get_ns();
+}
+
+// Push n items through wq and fill in res; lat and cpu_count are scratch
+// buffers of n and nr_cpu_ids entries
+static void ex7_bench_queue(struct workqueue_struct *wq, struct ex7_bench_item *items,
+                            unsigned int n, u64 *lat, unsigned int *cpu_count,
+                            struct ex7_bench_result *res)
+{
+    u64 first, last = 0;
+    unsigned int i, busiest = 0;
+    int cpu;
+
+    migrate_disable(); // Every item submitted from the same CPU
+    for (i = 0; i < n; i++) {
+        INIT_WORK(&items[i].work, ex7_bench_fn);
+        items[i].queued_ns = ktime_get_ns();
+        queue_work(wq, &items[i].work);
+    }
+    migrate_enable();
+    // flush_work() rather than flush_workqueue(): system_wq must not be flushed
+    for (i = 0; i < n; i++)
+        flush_work(&items[i].work);
+
+    memset(cpu_count, 0, nr_cpu_ids * sizeof(*cpu_count));
+    first = items[0].queued_ns;
+    for (i = 0; i < n; i++) {
+        lat[i] = items[i].start_ns - items[i].queued_ns;
+        last = max(last, items[i].end_ns);
+        cpu_count[items[i].cpu]++;
+    }
+    defer_samples_sort(lat, n);
+
+    res->items = n;
+    res->p50_ns = defer_sample_percentile(lat, n, 5000);
+    res->p90_ns = defer_sample_percentile(lat, n, 9000);
+    res->p99_ns = defer_sample_percentile(lat, n, 9900);
+    res->max_ns = lat[n - 1];
+    res->elapsed_ns = last - first;
+    res->per_sec = div64_u64((u64)n * NSEC_PER_SEC, max(res->elapsed_ns, 1ULL));
+    res->cpus = 0;
+    for_each_possible_cpu(cpu) {
+        if (cpu_count[cpu])
+            res->cpus++;
+        busiest = max(busiest, cpu_count[cpu]);
+    }
+    res->max_cpu_pct = busiest * 100 / n;
+}
+
+static int ex7_bench_one(const struct ex7_bench_flavor *f, int max_active,
+                         struct ex7_bench_item *items, unsigned int n,
+                         u64 *lat, unsigned int *cpu_count)
+{
+    struct ex7_bench_result *res = &ex7_bench_results[ex7_bench_nr_results];
+    struct workqueue_struct *wq;
+
+    if (!strcmp(f->name, "system"))
+        wq = system_wq;
+    else if (!strcmp(f->name, "ordered"))
+        wq = alloc_ordered_workqueue("ex7_bench_%s", 0, f->name);
+    else
+        wq = alloc_workqueue("ex7_bench_%s_%d", f->flags, max_active, f->name, max_active);
+    if (!wq)
+        return -ENOMEM;
+
+    res->flavor = f->name;
+    res->flags = f->flags;
+    res->max_active = !strcmp(f->name, "ordered") ? 1 : max_active;
+    ex7_bench_queue(wq, items, n, lat, cpu_count, res);
+    ex7_bench_nr_results++;
+
+    if (wq != system_wq)
+        destroy_workqueue(wq);
+    defer_dbg("Ex7 Bench: %s max_active %d: p50 %llu p99 %llu ns, %llu items/s\n",
+              f->name, res->max_active, res->p50_ns, res->p99_ns, res->per_sec);
+    return 0;
+}
+
+static int ex7_bench_run(void)
+{
+    unsigned int n = min(bench_items, EX7_BENCH_MAX_ITEMS);
+    struct ex7_bench_item *items;
+    unsigned int *cpu_count;
+    u64 *lat;
+    unsigned int i, j;
+    int ret = 0;
+
+    if (!n)
+        return -EINVAL;
+    items = kvcalloc(n, sizeof(*items), GFP_KERNEL);
+    lat = kvcalloc(n, sizeof(*lat), GFP_KERNEL);
+    cpu_count = kcalloc(nr_cpu_ids, sizeof(*cpu_count), GFP_KERNEL);
+    if (!items || !lat || !cpu_count) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    mutex_lock(&ex7_bench_lock);
+    ex7_bench_nr_results = 0;
+    for (i = 0; i < ARRAY_SIZE(ex7_bench_flavors) && !ret; i++) {
+        const struct ex7_bench_flavor *f = &ex7_bench_flavors[i];
+
+        if (f->fixed) {
+            ret = ex7_bench_one(f, 0, items, n, lat, cpu_count);
+            continue;
+        }
+        for (j = 0; j < bench_nr_max_active && !ret; j++)
+            ret = ex7_bench_one(f, bench_max_active[j], items, n, lat, cpu_count);
+    }
+    mutex_unlock(&ex7_bench_lock);
+    pr_info("Ex7 Bench: %u queues benchmarked with %u items each.\n",
+            ex7_bench_nr_results, n);
+out:
+    kfree(cpu_count);
+    kvfree(lat);
+    kvfree(items);
+    return ret;
+}
+
+DEFINE_DEFER_RUN_FOPS(ex7_bench_run_fops, ex7_bench_run);
+
+static int ex7_bench_results_show(struct seq_file *m, void *v)
+{
+    struct ex7_bench_result *res;
+    unsigned int i;
+
+    seq_puts(m, "flavor,flags,max_active,items,p50_ns,p90_ns,p99_ns,max_ns,"
+                "elapsed_ns,items_per_sec,cpus,max_cpu_pct\n");
+    mutex_lock(&ex7_bench_lock);
+    for (i = 0; i < ex7_bench_nr_results; i++) {
+        res = &ex7_bench_results[i];
+        seq_printf(m, "%s,%#x,%d,%u,%llu,%llu,%llu,%llu,%llu,%llu,%u,%u\n",
+                   res->flavor, res->flags, res->max_active, res->items,
+                   res->p50_ns, res->p90_ns, res->p99_ns, res->max_ns,
+                   res->elapsed_ns, res->per_sec, res->cpus, res->max_cpu_pct);
+    }
+    mutex_unlock(&ex7_bench_lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ex7_bench_results);
+
 static int __init ex7_init(void)
 {
+    int i;
+
     pr_info("Ex7 Module (Default WQ): Loading...\n");
 
+    // alloc_workqueue() would clamp these, and the CSV would then report a
+    // max_active the run never used
+    for (i = 0; i < bench_nr_max_active; i++) {
+        if (bench_max_active[i] < 0 || bench_max_active[i] > WQ_MAX_ACTIVE) {
+            pr_err("Ex7: bench_max_active must be 0-%d.\n", WQ_MAX_ACTIVE);
+            return -EINVAL;
+        }
+    }
+
+    ex7_debugfs_dir = debugfs_create_dir("ex7", NULL);
+    debugfs_create_file("run", 0200, ex7_debugfs_dir, NULL, &ex7_bench_run_fops);
+    debugfs_create_file("results.csv", 0444, ex7_debugfs_dir, NULL, &ex7_bench_results_fops);
+
     // No need to create a workqueue!
 
     // Schedule normal work on the default workqueue
+    trace_defer_schedule(&normal_work, 0, false);
     if (!schedule_work(&normal_work)) {
         pr_info("Ex7: The normal work was already queued!\n");
     } else {
@@ -34,6 +295,7 @@ static int __init ex7_init(void)
     }
 
     // Schedule delayed work on the default workqueue (delay 3 seconds)
+    trace_defer_schedule(&delayed_work.work, 1, false);
     if (!schedule_delayed_work(&delayed_work, 3 * HZ)) {
         pr_info("Ex7: The delayed work was already queued!\n");
     } else {
@@ -47,6 +309,8 @@ static void __exit ex7_exit(void)
 {
     pr_info("Ex7 Module (Default WQ): Exiting...\n");
 
+    debugfs_remove_recursive(ex7_debugfs_dir);
+
     // Cancel the work items. Functions work regardless of queue type.
     pr_info("Ex7: Cancelling work items...\n");
 
@@ -72,5 +336,5 @@ module_exit(ex7_exit);
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Oliver Jędrzejczyk");
-MODULE_DESCRIPTION("Exercise 7: Listing 2 using default work queue");
+MODULE_DESCRIPTION("Exercise 7: Listing 2 using default work queue, plus a workqueue flavor benchmark");
 MODULE_VERSION("1.0");
\ No newline at end of file
@@ -5,19 +5,243 @@
 #include <linux/jiffies.h>   // HZ
 #include <linux/err.h>       // IS_ERR, PTR_ERR
 #include <linux/slab.h>      // kmalloc/kfree (if needed for data)
+#include <linux/mm.h>        // kvmalloc_node, virt_to_page, page_to_nid
+#include <linux/nodemask.h>  // Online NUMA nodes
+#include <linux/topology.h>  // cpu_to_node
+#include <linux/ktime.h>     // ktime_get_ns
+#include <linux/math64.h>    // div64_u64
+#include <linux/mutex.h>     // Serialises benchmark runs
+#include <linux/debugfs.h>   // Benchmark control and results
+#include <linux/seq_file.h>  // numa_results.csv
+#include <linux/string.h>    // memset
+#include "defer_log.h"       // defer_dbg, verbose parameter
+#include "defer_run.h"       // debugfs "run" trigger
+
+#define DEFER_TRACE_SYSTEM ex8
+#define CREATE_TRACE_POINTS
+#include "defer_trace.h"     // defer_schedule/start/end/free events
+
+DEFINE_DEFER_VERBOSE();
 
 // Need a pointer for the dynamically allocated workqueue
 static struct workqueue_struct *my_unbound_wq = NULL;
 
+// --- Placement control ---
+//
+// The queue is created with WQ_SYSFS, so its workqueue_attrs can be
+// changed at runtime under /sys/devices/virtual/workqueue/ex8_unbound_wq/:
+//     cpumask         - CPUs its workers may run on
+//     nice            - nice level of its workers
+//     affinity_scope  - cpu, smt, cache, numa or system: how far from the
+//                       queueing CPU a work item may run (6.5+)
+//     affinity_strict - 1 keeps workers inside the scope even when idle
+//                       CPUs exist elsewhere (6.5+)
+// apply_workqueue_attrs() is not exported to modules, so the sysfs files
+// are the supported control; everything below honours whatever is set
+// there.
+//
+// ex8_queue_local() queues an item on a worker of the NUMA node its
+// payload lives on. It looks the node up from the payload's page rather
+// than trusting the node the caller asked for, since kvmalloc_node() may
+// fall back to another node.
+
+struct ex8_item {
+    struct work_struct work;
+    void *payload;
+    size_t size;
+    int node;       // Node the payload's memory is on
+    int target;     // Node it was queued for
+    // Filled in by the handler
+    int ran_node;
+    u64 work_ns;
+    u64 sum;
+};
+
+// Node of the payload's first page
+static int ex8_payload_node(const void *payload)
+{
+    if (is_vmalloc_addr(payload))
+        return page_to_nid(vmalloc_to_page(payload));
+    return page_to_nid(virt_to_page(payload));
+}
+
+// queue_work_node() picks a CPU of node within the queue's cpumask, or
+// any allowed CPU if the node has none
+static bool ex8_queue_on_node(struct ex8_item *item, int node)
+{
+    item->target = node;
+    return queue_work_node(node, my_unbound_wq, &item->work);
+}
+
+static bool ex8_queue_local(struct ex8_item *item)
+{
+    return ex8_queue_on_node(item, item->node);
+}
+
+// --- Local vs. remote benchmark ---
+//
+// For every online node, allocates bench_items payloads of bench_payload_kb
+// there and has a work item read each one bench_passes times, once queued
+// on the payload's own node (ex8_queue_local) and once on the next online
+// node. On a multi-node machine or a QEMU guest with several -numa nodes
+// the remote rows show the cost of touching far memory; on one node the
+// two rows match. Start with "echo run > /sys/kernel/debug/ex8/numa_bench"
+// and read /sys/kernel/debug/ex8/numa_results.csv:
+//     placement,items,payload_kb,on_target_pct,avg_ns,max_ns,mb_per_sec
+
+static unsigned int bench_items = 64;
+module_param(bench_items, uint, 0644);
+MODULE_PARM_DESC(bench_items, "Benchmark payloads per node");
+
+static unsigned int bench_payload_kb = 1024;
+module_param(bench_payload_kb, uint, 0644);
+MODULE_PARM_DESC(bench_payload_kb, "Benchmark payload size (KiB); larger than the LLC shows memory latency");
+
+static unsigned int bench_passes = 4;
+module_param(bench_passes, uint, 0644);
+MODULE_PARM_DESC(bench_passes, "Times each payload is read");
+
+enum { EX8_LOCAL, EX8_REMOTE, EX8_NR_PLACEMENTS };
+
+static const char * const ex8_placement_names[EX8_NR_PLACEMENTS] = {
+    [EX8_LOCAL] = "local",
+    [EX8_REMOTE] = "remote",
+};
+
+static struct {
+    unsigned int items;
+    unsigned int on_target_pct;
+    u64 avg_ns;
+    u64 max_ns;
+    u64 mb_per_sec;
+} ex8_bench_results[EX8_NR_PLACEMENTS];
+
+static DEFINE_MUTEX(ex8_bench_lock); // Protects ex8_bench_results
+static bool ex8_bench_done;
+static struct dentry *ex8_debugfs_dir;
+
+static void ex8_bench_fn(struct work_struct *work)
+{
+    struct ex8_item *item = container_of(work, struct ex8_item, work);
+    const u64 *p = item->payload;
+    size_t i, n = item->size / sizeof(*p);
+    unsigned int pass;
+    u64 start = ktime_get_ns(), sum = 0;
+
+    item->ran_node = cpu_to_node(raw_smp_processor_id());
+    for (pass = 0; pass < bench_passes; pass++)
+        for (i = 0; i < n; i++)
+            sum += READ_ONCE(p[i]);
+    item->sum = sum; // Keeps the loop from being optimised out
+    item->work_ns = ktime_get_ns() - start;
+}
+
+static void ex8_bench_placement(struct ex8_item *items, unsigned int n, int placement)
+{
+    u64 total = 0, max_ns = 0, bytes;
+    unsigned int i, on_target = 0;
+    int node;
+
+    for (i = 0; i < n; i++) {
+        INIT_WORK(&items[i].work, ex8_bench_fn);
+        if (placement == EX8_LOCAL) {
+            ex8_queue_local(&items[i]);
+        } else {
+            node = next_online_node(items[i].node);
+            ex8_queue_on_node(&items[i], node < MAX_NUMNODES ? node : first_online_node);
+        }
+    }
+    for (i = 0; i < n; i++)
+        flush_work(&items[i].work);
+
+    for (i = 0; i < n; i++) {
+        total += items[i].work_ns;
+        max_ns = max(max_ns, items[i].work_ns);
+        if (items[i].ran_node == items[i].target)
+            on_target++;
+    }
+    bytes = (u64)n * items[0].size * bench_passes;
+    ex8_bench_results[placement].items = n;
+    ex8_bench_results[placement].on_target_pct = on_target * 100 / n;
+    ex8_bench_results[placement].avg_ns = div64_u64(total, n);
+    ex8_bench_results[placement].max_ns = max_ns;
+    // Per-item read bandwidth: bytes / sum of handler times
+    ex8_bench_results[placement].mb_per_sec =
+        div64_u64(bytes * (NSEC_PER_SEC / 1000000), max(total, 1ULL));
+}
+
+static int ex8_bench_run(void)
+{
+    size_t size = (size_t)bench_payload_kb * 1024;
+    unsigned int i, n = 0, per_node = bench_items;
+    struct ex8_item *items;
+    int node, p, ret = 0;
+
+    if (!per_node || !size || !bench_passes)
+        return -EINVAL;
+    items = kvcalloc((size_t)per_node * num_online_nodes(), sizeof(*items), GFP_KERNEL);
+    if (!items)
+        return -ENOMEM;
+
+    for_each_online_node(node) {
+        for (i = 0; i < per_node; i++, n++) {
+            items[n].payload = kvmalloc_node(size, GFP_KERNEL, node);
+            if (!items[n].payload) {
+                ret = -ENOMEM;
+                goto out;
+            }
+            memset(items[n].payload, 0x5a, size); // Fault the pages in
+            items[n].size = size;
+            items[n].node = ex8_payload_node(items[n].payload);
+        }
+    }
+
+    mutex_lock(&ex8_bench_lock);
+    for (p = 0; p < EX8_NR_PLACEMENTS; p++)
+        ex8_bench_placement(items, n, p);
+    ex8_bench_done = true;
+    mutex_unlock(&ex8_bench_lock);
+    pr_info("Ex8 Bench: %u payloads on %u nodes, local %llu ns vs. remote %llu ns per item.\n",
+            n, num_online_nodes(), ex8_bench_results[EX8_LOCAL].avg_ns,
+            ex8_bench_results[EX8_REMOTE].avg_ns);
+out:
+    for (i = 0; i < n; i++)
+        kvfree(items[i].payload);
+    kvfree(items);
+    return ret;
+}
+
+DEFINE_DEFER_RUN_FOPS(ex8_bench_fops, ex8_bench_run);
+
+static int ex8_bench_results_show(struct seq_file *m, void *v)
+{
+    int p;
+
+    seq_puts(m, "placement,items,payload_kb,on_target_pct,avg_ns,max_ns,mb_per_sec\n");
+    mutex_lock(&ex8_bench_lock);
+    for (p = 0; ex8_bench_done && p < EX8_NR_PLACEMENTS; p++)
+        seq_printf(m, "%s,%u,%u,%u,%llu,%llu,%llu\n", ex8_placement_names[p],
+                   ex8_bench_results[p].items, bench_payload_kb,
+                   ex8_bench_results[p].on_target_pct, ex8_bench_results[p].avg_ns,
+                   ex8_bench_results[p].max_ns, ex8_bench_results[p].mb_per_sec);
+    mutex_unlock(&ex8_bench_lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ex8_bench_results);
+
 // Handlers are the same as Listing 2 / Exercise 5
 static void normal_work_handler(struct work_struct *work)
 {
-    pr_info("Ex8 Normal Work Handler (Unbound WQ): Hi! I'm handler of normal work!\n");
+    trace_defer_start(work, 0, false);
+    defer_dbg("Ex8 Normal Work Handler (Unbound WQ): Hi! I'm handler of normal work!\n");
+    trace_defer_end(work, 0, false);
 }
 
 static void delayed_work_handler(struct work_struct *work)
 {
-    pr_info("Ex8 Delayed Work Handler (Unbound WQ): Hi! I'm handler of delayed work!\n");
+    trace_defer_start(work, 1, false);
+    defer_dbg("Ex8 Delayed Work Handler (Unbound WQ): Hi! I'm handler of delayed work!\n");
+    trace_defer_end(work, 1, false);
 }
 
 // Declare work items statically
@@ -30,15 +254,22 @@ static int __init ex8_init(void)
 
     // Allocate an unbound workqueue
     // Name format string, flags, max_active (0=unlimited for unbound)
-    my_unbound_wq = alloc_workqueue("ex8_unbound_wq", WQ_UNBOUND, 0);
+    // WQ_SYSFS exposes its attributes for runtime placement control
+    my_unbound_wq = alloc_workqueue("ex8_unbound_wq", WQ_UNBOUND | WQ_SYSFS, 0);
     if (!my_unbound_wq) {
         pr_err("Ex8: Failed to allocate unbound workqueue!\n");
         return -ENOMEM;
     }
     pr_info("Ex8: Allocated unbound workqueue 'ex8_unbound_wq'.\n");
 
+    ex8_debugfs_dir = debugfs_create_dir("ex8", NULL);
+    debugfs_create_file("numa_bench", 0200, ex8_debugfs_dir, NULL, &ex8_bench_fops);
+    debugfs_create_file("numa_results.csv", 0444, ex8_debugfs_dir, NULL,
+                        &ex8_bench_results_fops);
+
 
     // Schedule normal work on our unbound queue
+    trace_defer_schedule(&normal_work, 0, false);
     if (!queue_work(my_unbound_wq, &normal_work)) {
         pr_info("Ex8: The normal work was already queued!\n");
     } else {
@@ -46,6 +277,7 @@ static int __init ex8_init(void)
     }
 
     // Schedule delayed work on our unbound queue (delay 3 seconds)
+    trace_defer_schedule(&delayed_work.work, 1, false);
     if (!queue_delayed_work(my_unbound_wq, &delayed_work, 3 * HZ)) {
         pr_info("Ex8: The delayed work was already queued!\n");
     } else {
@@ -59,6 +291,9 @@ static void __exit ex8_exit(void)
 {
     pr_info("Ex8 Module (Alloc Unbound WQ): Exiting...\n");
 
+    // Before the queue goes: no benchmark may be started on it afterwards
+    debugfs_remove_recursive(ex8_debugfs_dir);
+
     // Check if queue was actually created before trying to use/destroy it
     if (my_unbound_wq) {
         // Cancel the work items. These need to be cancelled BEFORE destroying the queue.
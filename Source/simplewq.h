@@ -0,0 +1,50 @@
+#ifndef _SIMPLEWQ_H
+#define _SIMPLEWQ_H
+
+#include <linux/types.h>     // u64
+#include <linux/list.h>      // struct list_head
+#include <linux/llist.h>     // struct llist_node
+#include <linux/compiler.h>  // __aligned
+
+// SimpleWQ's public interface: the work item and queue_simple_work(),
+// exported by ex3 so other modules (e.g. defer_bench) can queue on its
+// per-CPU kthread pools.
+
+// Payloads up to this size are stored inside the work item itself
+#define SIMPLE_WORK_INLINE_SIZE 16
+
+// Work item flag bits
+#define SIMPLE_WORK_PENDING 0 // Queued and not yet started
+#define SIMPLE_WORK_OWNED   1 // Allocated by SimpleWQ, freed after it runs
+
+// Structure for our custom work item.
+// Callers can embed it in their own structures and queue it with
+// queue_simple_work(); no memory is allocated on that path. submit_work()
+// still allocates one item from simple_work_cache and keeps the payload in
+// inline_data, so there is no second allocation for the data.
+typedef struct {
+    union {
+        struct list_head list;      // Link for the spinlock queue
+        struct llist_node llnode;   // Link for the lock-free queue
+    };
+    void (*func)(void *);  // Function to execute
+    void *data;            // Data for the function
+    unsigned long flags;   // SIMPLE_WORK_* bits
+    u64 queued_ns;         // ktime_get_ns() at submission
+    unsigned char inline_data[SIMPLE_WORK_INLINE_SIZE] __aligned(sizeof(long));
+} simple_work_t;
+
+// Prepare an embedded work item. func receives the work item itself, so the
+// containing structure is found with container_of(data, struct ..., member).
+#define INIT_SIMPLE_WORK(work, fn)       \
+    do {                                 \
+        (work)->func = (fn);             \
+        (work)->data = (work);           \
+        (work)->flags = 0;               \
+    } while (0)
+
+// Queue a caller-owned work item on the local CPU's pool. Returns false if
+// it is already pending. Exported by ex3.
+bool queue_simple_work(simple_work_t *work);
+
+#endif // _SIMPLEWQ_H
@@ -0,0 +1,311 @@
+#ifndef _TASKLET_DISPATCH_H
+#define _TASKLET_DISPATCH_H
+
+#include <linux/interrupt.h>   // tasklet API
+#include <linux/irq_work.h>    // irq_work_queue_on
+#include <linux/llist.h>       // Per-CPU request queues
+#include <linux/percpu.h>      // Per-CPU state
+#include <linux/cpumask.h>     // cpu_online_mask
+#include <linux/cpuhotplug.h>  // Counter resync when a CPU dies
+#include <linux/moduleparam.h>
+#include <linux/seq_file.h>    // tasklet_dispatch_show
+#include <linux/string.h>      // sysfs_match_string
+
+// Steer tasklets to a chosen CPU.
+//
+// tasklet_schedule() always queues on the calling CPU, so one busy
+// producer ends up running every bottom half on its own core. A dispatcher
+// picks the target CPU by policy and, when that is not the local CPU,
+// hands the request over with irq_work_queue_on(); the irq_work handler on
+// the target then calls tasklet_schedule() there, so the tasklet runs on
+// the target.
+//
+// Policies (module parameter "dispatch"):
+//   local - the submitting CPU, i.e. plain tasklet_schedule()
+//   rr    - round-robin over the online CPUs
+//   least - the online CPU with the fewest dispatched-but-not-run requests
+//
+// Usage: DEFINE_TASKLET_DISPATCHER(name) once per module, then
+//   - tasklet_dispatcher_init(&name) from module init (may fail),
+//   - one struct tasklet_dispatch_req per tasklet (TASKLET_DISPATCH_REQ_INIT
+//     or tasklet_dispatch_req_init()),
+//   - tasklet_dispatch(&name, &req) instead of tasklet_schedule(),
+//   - tasklet_dispatch_ran(&name, &req) first thing in the handler,
+//   - tasklet_dispatcher_sync(&name) on exit after the last dispatch and
+//     before tasklet_kill(), so no irq_work can still schedule a tasklet,
+//   - tasklet_dispatcher_destroy(&name) last on exit.
+//
+// A request stays pending from dispatch until its handler starts, and
+// dispatching a pending request is a no-op, just as scheduling an already
+// scheduled tasklet is. That keeps the per-CPU dispatched and executed
+// counts exactly paired, and their difference is the "least" load metric.
+// When a CPU dies, its queued tasklets move to the CPU tearing it down;
+// tasklet_dispatch_cpu_dead() moves their share of the count with them.
+
+enum {
+    TASKLET_DISPATCH_LOCAL,
+    TASKLET_DISPATCH_RR,
+    TASKLET_DISPATCH_LEAST,
+    TASKLET_DISPATCH_NR_POLICIES,
+};
+
+static const char * const tasklet_dispatch_policy_names[TASKLET_DISPATCH_NR_POLICIES] = {
+    [TASKLET_DISPATCH_LOCAL] = "local",
+    [TASKLET_DISPATCH_RR] = "rr",
+    [TASKLET_DISPATCH_LEAST] = "least",
+};
+
+struct tasklet_dispatch_cpu {
+    struct irq_work work;       // Drains queue on this CPU
+    struct llist_head queue;    // Requests sent here from other CPUs
+    atomic_long_t dispatched;   // Requests targeted at this CPU
+    unsigned long executed;     // Handlers started here (this CPU only)
+    unsigned long remote;       // Requests that arrived by irq_work
+};
+
+struct tasklet_dispatcher {
+    struct tasklet_dispatch_cpu __percpu *cpus;
+    int policy;
+    int rr_last; // Round-robin cursor, racy by design
+    enum cpuhp_state cpuhp_state;
+    struct hlist_node cpuhp_node;
+};
+
+struct tasklet_dispatch_req {
+    struct llist_node node;
+    struct tasklet_struct *tasklet;
+    unsigned long pending; // Bit 0: dispatched, handler not started yet
+    bool hi;               // tasklet_hi_schedule()
+};
+
+#define TASKLET_DISPATCH_REQ_INIT(t, high) { .tasklet = (t), .hi = (high) }
+
+static inline void tasklet_dispatch_req_init(struct tasklet_dispatch_req *req,
+                                             struct tasklet_struct *t, bool hi)
+{
+    req->tasklet = t;
+    req->pending = 0;
+    req->hi = hi;
+}
+
+static inline void tasklet_dispatch_schedule_local(struct tasklet_dispatch_req *req)
+{
+    if (req->hi)
+        tasklet_hi_schedule(req->tasklet);
+    else
+        tasklet_schedule(req->tasklet);
+}
+
+static inline void tasklet_dispatch_irq_work(struct irq_work *work)
+{
+    struct tasklet_dispatch_cpu *pc = container_of(work, struct tasklet_dispatch_cpu, work);
+    struct tasklet_dispatch_req *req, *tmp;
+
+    // _safe: once scheduled, a request may run and be dispatched again
+    llist_for_each_entry_safe(req, tmp, llist_del_all(&pc->queue), node) {
+        pc->remote++;
+        tasklet_dispatch_schedule_local(req);
+    }
+}
+
+static inline long tasklet_dispatch_load(struct tasklet_dispatcher *d, int cpu)
+{
+    struct tasklet_dispatch_cpu *pc = per_cpu_ptr(d->cpus, cpu);
+
+    return atomic_long_read(&pc->dispatched) - (long)READ_ONCE(pc->executed);
+}
+
+// CPU hotplug teardown, run after the CPU is dead and before
+// tasklet_cpu_dead() moves its queued tasklets to the CPU doing the
+// teardown. Without this the dead CPU would keep their count, and the CPU
+// that runs them would go negative and attract every "least" dispatch.
+static inline int tasklet_dispatch_cpu_dead(unsigned int cpu, struct hlist_node *node)
+{
+    struct tasklet_dispatcher *d = hlist_entry(node, struct tasklet_dispatcher, cpuhp_node);
+    long outstanding = tasklet_dispatch_load(d, cpu);
+
+    if (outstanding > 0) {
+        atomic_long_sub(outstanding, &per_cpu_ptr(d->cpus, cpu)->dispatched);
+        atomic_long_add(outstanding, &per_cpu_ptr(d->cpus, raw_smp_processor_id())->dispatched);
+    }
+    return 0;
+}
+
+static inline int tasklet_dispatcher_init(struct tasklet_dispatcher *d)
+{
+    int cpu, ret;
+
+    for_each_possible_cpu(cpu)
+        init_irq_work(&per_cpu_ptr(d->cpus, cpu)->work, tasklet_dispatch_irq_work);
+
+    ret = cpuhp_setup_state_multi(CPUHP_BP_PREPARE_DYN, KBUILD_MODNAME ":dispatch_dead",
+                                  NULL, tasklet_dispatch_cpu_dead);
+    if (ret < 0)
+        return ret;
+    d->cpuhp_state = ret;
+    ret = cpuhp_state_add_instance_nocalls(d->cpuhp_state, &d->cpuhp_node);
+    if (ret)
+        cpuhp_remove_multi_state(d->cpuhp_state);
+    return ret;
+}
+
+static inline void tasklet_dispatcher_destroy(struct tasklet_dispatcher *d)
+{
+    cpuhp_state_remove_instance_nocalls(d->cpuhp_state, &d->cpuhp_node);
+    cpuhp_remove_multi_state(d->cpuhp_state);
+}
+
+// Wait until no irq_work of this dispatcher is queued or running
+static inline void tasklet_dispatcher_sync(struct tasklet_dispatcher *d)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        irq_work_sync(&per_cpu_ptr(d->cpus, cpu)->work);
+}
+
+// Pick a target CPU. Called with preemption disabled, which also keeps the
+// online CPUs online until the request is queued.
+static inline int tasklet_dispatch_pick(struct tasklet_dispatcher *d, int this_cpu)
+{
+    int cpu, best;
+    long load, best_load;
+
+    switch (READ_ONCE(d->policy)) {
+    case TASKLET_DISPATCH_RR:
+        cpu = cpumask_next(READ_ONCE(d->rr_last), cpu_online_mask);
+        if (cpu >= nr_cpu_ids)
+            cpu = cpumask_first(cpu_online_mask);
+        WRITE_ONCE(d->rr_last, cpu);
+        return cpu;
+    case TASKLET_DISPATCH_LEAST:
+        // O(online CPUs) per dispatch; ties go to the local CPU
+        best = this_cpu;
+        best_load = tasklet_dispatch_load(d, this_cpu);
+        for_each_online_cpu(cpu) {
+            if (!best_load)
+                break;
+            load = tasklet_dispatch_load(d, cpu);
+            if (load < best_load) {
+                best = cpu;
+                best_load = load;
+            }
+        }
+        return best;
+    default:
+        return this_cpu;
+    }
+}
+
+// Dispatch req to cpu, which must be online; preemption disabled
+static inline void tasklet_dispatch_to(struct tasklet_dispatcher *d,
+                                       struct tasklet_dispatch_req *req, int cpu)
+{
+    struct tasklet_dispatch_cpu *pc = per_cpu_ptr(d->cpus, cpu);
+
+    if (test_and_set_bit(0, &req->pending))
+        return; // Still queued or scheduled; it will run once for both
+
+    atomic_long_inc(&pc->dispatched);
+    if (cpu == smp_processor_id()) {
+        tasklet_dispatch_schedule_local(req);
+    } else {
+        llist_add(&req->node, &pc->queue);
+        irq_work_queue_on(&pc->work, cpu); // No-op if already queued
+    }
+}
+
+// Schedule req's tasklet on a CPU chosen by the dispatcher's policy.
+// Returns the target CPU.
+static inline int tasklet_dispatch(struct tasklet_dispatcher *d,
+                                   struct tasklet_dispatch_req *req)
+{
+    int cpu;
+
+    preempt_disable();
+    cpu = tasklet_dispatch_pick(d, smp_processor_id());
+    tasklet_dispatch_to(d, req, cpu);
+    preempt_enable();
+    return cpu;
+}
+
+// Call first thing in the tasklet handler. Clearing pending before the
+// body runs means a dispatch from inside or during the run queues it again.
+static inline void tasklet_dispatch_ran(struct tasklet_dispatcher *d,
+                                        struct tasklet_dispatch_req *req)
+{
+    struct tasklet_dispatch_cpu *pc = this_cpu_ptr(d->cpus);
+
+    WRITE_ONCE(pc->executed, pc->executed + 1);
+    clear_bit(0, &req->pending);
+    smp_mb__after_atomic();
+}
+
+static inline bool tasklet_dispatch_pending(struct tasklet_dispatch_req *req)
+{
+    return test_bit(0, &req->pending);
+}
+
+static inline void tasklet_dispatch_show(struct seq_file *m, struct tasklet_dispatcher *d)
+{
+    struct tasklet_dispatch_cpu *pc;
+    int cpu;
+
+    seq_printf(m, "--- Dispatch (policy %s) ---\n",
+               tasklet_dispatch_policy_names[READ_ONCE(d->policy)]);
+    for_each_online_cpu(cpu) {
+        pc = per_cpu_ptr(d->cpus, cpu);
+        seq_printf(m, "cpu%-3d dispatched %ld executed %lu remote %lu\n", cpu,
+                   atomic_long_read(&pc->dispatched), READ_ONCE(pc->executed),
+                   READ_ONCE(pc->remote));
+    }
+}
+
+// pr_info() summary for modules without a proc file
+static inline void tasklet_dispatch_report(struct tasklet_dispatcher *d, const char *who)
+{
+    struct tasklet_dispatch_cpu *pc;
+    int cpu;
+
+    for_each_online_cpu(cpu) {
+        pc = per_cpu_ptr(d->cpus, cpu);
+        if (atomic_long_read(&pc->dispatched))
+            pr_info("%s: cpu%d dispatched %ld executed %lu remote %lu\n", who, cpu,
+                    atomic_long_read(&pc->dispatched), READ_ONCE(pc->executed),
+                    READ_ONCE(pc->remote));
+    }
+}
+
+// Defines the dispatcher and its "dispatch" module parameter
+#define DEFINE_TASKLET_DISPATCHER(name)                                             \
+    static DEFINE_PER_CPU(struct tasklet_dispatch_cpu, name##_cpus);                \
+    static struct tasklet_dispatcher name = {                                       \
+        .cpus = &name##_cpus,                                                       \
+        .policy = TASKLET_DISPATCH_LOCAL,                                           \
+        .rr_last = -1,                                                              \
+    };                                                                              \
+                                                                                    \
+    static int name##_policy_set(const char *val, const struct kernel_param *kp)    \
+    {                                                                               \
+        int policy = sysfs_match_string(tasklet_dispatch_policy_names, val);        \
+                                                                                    \
+        if (policy < 0)                                                             \
+            return policy;                                                          \
+        WRITE_ONCE(name.policy, policy);                                            \
+        return 0;                                                                   \
+    }                                                                               \
+                                                                                    \
+    static int name##_policy_get(char *buf, const struct kernel_param *kp)          \
+    {                                                                               \
+        return sprintf(buf, "%s\n",                                                 \
+                       tasklet_dispatch_policy_names[READ_ONCE(name.policy)]);      \
+    }                                                                               \
+                                                                                    \
+    static const struct kernel_param_ops name##_policy_ops = {                      \
+        .set = name##_policy_set,                                                   \
+        .get = name##_policy_get,                                                   \
+    };                                                                              \
+    module_param_cb(dispatch, &name##_policy_ops, NULL, 0644);                      \
+    MODULE_PARM_DESC(dispatch, "Tasklet steering policy: local, rr or least")
+
+#endif // _TASKLET_DISPATCH_H
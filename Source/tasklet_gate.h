@@ -0,0 +1,154 @@
+#ifndef _TASKLET_GATE_H
+#define _TASKLET_GATE_H
+
+#include <linux/interrupt.h>   // tasklet API
+#include <linux/percpu.h>      // Per-CPU rings
+#include <linux/spinlock.h>    // Ring locks
+#include <linux/slab.h>        // kvmalloc_array, kvfree
+#include <linux/log2.h>        // ilog2
+#include <linux/printk.h>      // tasklet_gate_report
+
+// Keep the payload of every schedule, not just the last one.
+//
+// A tasklet carries one fixed data value, and any number of
+// tasklet_schedule() calls made before it runs - for instance while it is
+// disabled - collapse into a single run. A gate gives each schedule call
+// its own payload: tasklet_gate_push() appends the payload to a ring on
+// the calling CPU, and the handler collects everything pushed since its
+// last run with tasklet_gate_collect() and gets it as one vector. The
+// tasklet itself is scheduled, enabled and disabled as usual, so a
+// tasklet_enable() after a pause delivers the whole backlog in one run.
+//
+// Usage: DEFINE_TASKLET_GATE(name) once per module, then
+//   - tasklet_gate_init(&name) from module init (allocates the rings and
+//     the vector),
+//   - tasklet_gate_push(&name, payload) before every tasklet_schedule(),
+//   - n = tasklet_gate_collect(&name) in the handler, after which
+//     name.vec[0..n-1] holds the payloads,
+//   - tasklet_gate_destroy(&name) on exit after tasklet_kill().
+//
+// Payloads are in push order per CPU; the vector lists the CPUs in turn.
+// A push to a full ring is dropped and counted. The handler must clear any
+// pending state (e.g. tasklet_dispatch_ran()) before collecting, so a push
+// racing with the run schedules another run rather than being stranded.
+
+#define TASKLET_GATE_RING 256 // Payloads per CPU, power of two
+#define TASKLET_GATE_HIST 16  // log2 buckets of payloads per run
+
+struct tasklet_gate_cpu {
+    spinlock_t lock;
+    unsigned int head;      // Next slot to fill
+    unsigned int tail;      // Next slot to collect
+    unsigned long dropped;  // Pushes that found the ring full
+    unsigned long buf[TASKLET_GATE_RING];
+};
+
+struct tasklet_gate {
+    // Dynamically allocated: at 2 KiB per CPU the rings would eat much of
+    // the small reserve that backs static per-CPU data in modules
+    struct tasklet_gate_cpu __percpu *cpus;
+    unsigned long *vec;     // nr_cpu_ids * TASKLET_GATE_RING slots
+    // Written only by the (self-serialised) tasklet handler
+    unsigned long runs;
+    unsigned long delivered;
+    unsigned long max_batch;
+    unsigned long hist[TASKLET_GATE_HIST]; // Runs by ilog2(payloads)
+};
+
+static inline int tasklet_gate_init(struct tasklet_gate *g)
+{
+    int cpu;
+
+    g->cpus = alloc_percpu(struct tasklet_gate_cpu); // Zeroed
+    if (!g->cpus)
+        return -ENOMEM;
+    for_each_possible_cpu(cpu)
+        spin_lock_init(&per_cpu_ptr(g->cpus, cpu)->lock);
+    // 2 KiB per CPU: too big for a contiguous allocation on large machines
+    g->vec = kvmalloc_array(nr_cpu_ids, TASKLET_GATE_RING * sizeof(*g->vec), GFP_KERNEL);
+    if (!g->vec) {
+        free_percpu(g->cpus);
+        g->cpus = NULL;
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+static inline void tasklet_gate_destroy(struct tasklet_gate *g)
+{
+    kvfree(g->vec);
+    g->vec = NULL;
+    free_percpu(g->cpus);
+    g->cpus = NULL;
+}
+
+// Queue payload for the next run; any context. Returns false if the
+// calling CPU's ring is full and the payload was dropped.
+static inline bool tasklet_gate_push(struct tasklet_gate *g, unsigned long payload)
+{
+    struct tasklet_gate_cpu *gc;
+    unsigned long flags;
+    bool ok;
+
+    local_irq_save(flags);
+    gc = this_cpu_ptr(g->cpus);
+    spin_lock(&gc->lock);
+    ok = gc->head - gc->tail < TASKLET_GATE_RING;
+    if (ok)
+        gc->buf[gc->head++ & (TASKLET_GATE_RING - 1)] = payload;
+    else
+        WRITE_ONCE(gc->dropped, gc->dropped + 1);
+    spin_unlock(&gc->lock);
+    local_irq_restore(flags);
+    return ok;
+}
+
+// Move every queued payload into g->vec; call from the tasklet handler.
+// Returns the number of payloads, i.e. the schedules this run stands for.
+static inline unsigned int tasklet_gate_collect(struct tasklet_gate *g)
+{
+    struct tasklet_gate_cpu *gc;
+    unsigned long flags;
+    unsigned int n = 0;
+    int cpu, bucket;
+
+    for_each_possible_cpu(cpu) {
+        gc = per_cpu_ptr(g->cpus, cpu);
+        spin_lock_irqsave(&gc->lock, flags);
+        while (gc->tail != gc->head)
+            g->vec[n++] = gc->buf[gc->tail++ & (TASKLET_GATE_RING - 1)];
+        spin_unlock_irqrestore(&gc->lock, flags);
+    }
+
+    WRITE_ONCE(g->runs, g->runs + 1);
+    WRITE_ONCE(g->delivered, g->delivered + n);
+    if (n > g->max_batch)
+        WRITE_ONCE(g->max_batch, n);
+    if (n) {
+        bucket = min_t(int, ilog2(n), TASKLET_GATE_HIST - 1);
+        WRITE_ONCE(g->hist[bucket], g->hist[bucket] + 1);
+    }
+    return n;
+}
+
+// pr_info() summary: runs, payloads per run and drops
+static inline void tasklet_gate_report(struct tasklet_gate *g, const char *who)
+{
+    unsigned long dropped = 0, runs = READ_ONCE(g->runs);
+    int cpu, i;
+
+    for_each_possible_cpu(cpu)
+        dropped += READ_ONCE(per_cpu_ptr(g->cpus, cpu)->dropped);
+
+    pr_info("%s: gate runs %lu payloads %lu (avg %lu, max %lu per run) dropped %lu\n",
+            who, runs, READ_ONCE(g->delivered),
+            runs ? READ_ONCE(g->delivered) / runs : 0, READ_ONCE(g->max_batch), dropped);
+    for (i = 0; i < TASKLET_GATE_HIST; i++)
+        if (READ_ONCE(g->hist[i]))
+            pr_info("%s:   %lu-%lu payloads: %lu runs\n", who,
+                    1UL << i, (2UL << i) - 1, READ_ONCE(g->hist[i]));
+}
+
+#define DEFINE_TASKLET_GATE(name) static struct tasklet_gate name
+
+#endif // _TASKLET_GATE_H
@@ -0,0 +1,56 @@
+#ifndef _TASKLET_STATS_ABI_H
+#define _TASKLET_STATS_ABI_H
+
+#include <linux/types.h> // __u32/__u64, usable from user space too
+
+// Binary layout of /sys/kernel/debug/ex6/stats.bin, shared by ex6.c and
+// user-space collectors (see Tools/tasklet_stats_dump.py).
+//
+// The file is a header followed by nr_cpus fixed-size slots, one per
+// possible CPU. Map it read-only with mmap() (or read() it) and copy out
+// a snapshot the way a seqcount reader would:
+//
+//     do {
+//         seq = hdr->seq;              // odd: update in progress, retry
+//         read barrier
+//         copy what you need
+//         read barrier
+//     } while ((seq & 1) || seq != hdr->seq);
+//
+// ex6 republishes the snapshot every publish_ms milliseconds, so after the
+// initial mmap() a reader needs no syscalls and takes no locks.
+//
+// Bump TASKLET_STATS_VERSION on any incompatible change. Fields may be
+// appended to either struct without a bump; locate the slots with hdr_size
+// and cpu_size rather than sizeof().
+
+#define TASKLET_STATS_MAGIC   0x4c4b5354 // "TSKL" in little-endian
+#define TASKLET_STATS_VERSION 2
+#define TASKLET_STATS_BUCKETS 32 // log2(ns) latency buckets
+#define TASKLET_STATS_NR_PRIO 2  // [0] normal, [1] high priority
+#define TASKLET_STATS_NR_BACKENDS 2 // [0] tasklet, [1] BH workqueue
+
+struct tasklet_stats_hdr {
+    __u32 magic;
+    __u32 version;
+    __u32 seq;        // Odd while the kernel is updating
+    __u32 hdr_size;   // Offset of the first CPU slot
+    __u32 cpu_size;   // Stride between CPU slots
+    __u32 nr_cpus;    // Number of slots (nr_cpu_ids)
+    __u64 publish_ns; // ktime_get_ns() of the last publish
+    __u64 reclaimed;  // Entries returned to the slab cache
+};
+
+struct tasklet_stats_cpu {
+    __u32 online;
+    __u32 reserved;
+    __u64 created;
+    __u64 scheduled;
+    __u64 executed;
+    __u64 high_prio;
+    __u64 be_executed[TASKLET_STATS_NR_BACKENDS];
+    __u64 lat_max[TASKLET_STATS_NR_BACKENDS][TASKLET_STATS_NR_PRIO];
+    __u64 lat_hist[TASKLET_STATS_NR_BACKENDS][TASKLET_STATS_NR_PRIO][TASKLET_STATS_BUCKETS];
+} __attribute__((aligned(64)));
+
+#endif // _TASKLET_STATS_ABI_H
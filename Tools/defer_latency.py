@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""Per-mechanism latency report from defer_* trace events.
+
+Enable the events of the loaded modules, run the workload, then feed the
+ftrace text output to this script:
+
+    echo 1 > /sys/kernel/tracing/events/ex6/enable
+    cat /sys/kernel/tracing/trace > ex6.trace
+    Tools/defer_latency.py ex6.trace
+
+Events are paired per (mechanism, item pointer):
+  dispatch = defer_schedule -> defer_start (queueing / softirq delay)
+  run      = defer_start    -> defer_end   (handler runtime)
+Schedules that arrive while an item is already pending collapse into one
+run, as tasklets and work items do; they are counted as "coalesced".
+Delayed work includes its requested delay in the dispatch figure.
+"""
+
+import argparse
+import re
+import sys
+from collections import defaultdict
+
+EVENT_RE = re.compile(
+    r"\s(?P<ts>\d+\.\d+):\s+defer_(?P<ev>schedule|start|end|free):\s+"
+    r"mech=(?P<mech>\S+)\s+item=(?P<item>\S+)\s+data=(?P<data>\d+)\s+hi=(?P<hi>\d)"
+)
+
+PERCENTILES = (50, 90, 99, 99.9)
+
+
+def percentile(sorted_values, pct):
+    if not sorted_values:
+        return 0.0
+    idx = min(len(sorted_values) - 1, int(round(pct / 100.0 * (len(sorted_values) - 1))))
+    return sorted_values[idx]
+
+
+class Stats:
+    def __init__(self):
+        self.dispatch = []
+        self.run = []
+        self.coalesced = 0
+        self.freed = 0
+
+
+def parse(lines):
+    stats = defaultdict(Stats)
+    pending = {}   # (mech, item) -> first schedule timestamp
+    running = {}   # (mech, item) -> start timestamp
+    for line in lines:
+        m = EVENT_RE.search(line)
+        if not m:
+            continue
+        ts = float(m.group("ts"))
+        ev = m.group("ev")
+        mech = m.group("mech")
+        key = (mech, m.group("item"))
+        group = stats[(mech, "hi" if m.group("hi") == "1" else "normal")]
+
+        if ev == "schedule":
+            if key in pending:
+                group.coalesced += 1
+            else:
+                pending[key] = ts
+        elif ev == "start":
+            queued = pending.pop(key, None)
+            if queued is not None:
+                group.dispatch.append((ts - queued) * 1e6)
+            running[key] = ts
+        elif ev == "end":
+            started = running.pop(key, None)
+            if started is not None:
+                group.run.append((ts - started) * 1e6)
+        elif ev == "free":
+            group.freed += 1
+            pending.pop(key, None)
+    return stats
+
+
+def print_report(stats, out):
+    header = "%-8s %-6s %-8s %8s" % ("mech", "prio", "metric", "count")
+    header += "".join(" %10s" % ("p%g" % p) for p in PERCENTILES)
+    header += " %10s %10s" % ("max", "mean")
+    out.write(header + "\n")
+    for (mech, prio) in sorted(stats):
+        group = stats[(mech, prio)]
+        for name, values in (("dispatch", group.dispatch), ("run", group.run)):
+            if not values:
+                continue
+            values.sort()
+            row = "%-8s %-6s %-8s %8d" % (mech, prio, name, len(values))
+            row += "".join(" %10.2f" % percentile(values, p) for p in PERCENTILES)
+            row += " %10.2f %10.2f" % (values[-1], sum(values) / len(values))
+            out.write(row + "\n")
+        if group.coalesced or group.freed:
+            out.write("%-8s %-6s coalesced schedules %d, frees %d\n"
+                      % (mech, prio, group.coalesced, group.freed))
+    out.write("(all times in microseconds)\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("trace", nargs="*", help="ftrace text output (default: stdin)")
+    args = parser.parse_args()
+
+    if args.trace:
+        lines = []
+        for path in args.trace:
+            with open(path) as f:
+                lines.extend(f)
+    else:
+        lines = sys.stdin
+
+    print_report(parse(lines), sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
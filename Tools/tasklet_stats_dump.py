@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""Read ex6's binary stats export without going through /proc.
+
+Maps /sys/kernel/debug/ex6/stats.bin (layout in Source/tasklet_stats_abi.h)
+and takes a seqcount-consistent snapshot. With --interval it keeps the
+mapping and polls, printing per-interval deltas:
+
+    Tools/tasklet_stats_dump.py
+    Tools/tasklet_stats_dump.py --interval 0.1
+"""
+
+import argparse
+import mmap
+import struct
+import sys
+import time
+
+MAGIC = 0x4C4B5354
+VERSION = 2
+BUCKETS = 32
+NR_PRIO = 2
+BACKENDS = ("tasklet", "bh")
+NR_HIST = len(BACKENDS) * NR_PRIO  # lat_max/lat_hist are [backend][prio]
+
+HDR = struct.Struct("<6I2Q")  # magic version seq hdr_size cpu_size nr_cpus publish_ns reclaimed
+CPU = struct.Struct("<2I4Q%dQ%dQ%dQ" % (len(BACKENDS), NR_HIST, NR_HIST * BUCKETS))
+BE_EXEC = 6
+LAT_MAX = BE_EXEC + len(BACKENDS)
+LAT_HIST = LAT_MAX + NR_HIST
+SEQ_OFFSET = 8
+
+
+def snapshot(buf):
+    """Copy the header and all CPU slots, retrying while the kernel updates."""
+    while True:
+        (seq,) = struct.unpack_from("<I", buf, SEQ_OFFSET)
+        if seq & 1:
+            continue
+        hdr = HDR.unpack_from(buf, 0)
+        magic, version, _, hdr_size, cpu_size, nr_cpus, publish_ns, reclaimed = hdr
+        cpus = [CPU.unpack_from(buf, hdr_size + i * cpu_size) for i in range(nr_cpus)]
+        (again,) = struct.unpack_from("<I", buf, SEQ_OFFSET)
+        if again == seq:
+            break
+    if magic != MAGIC or version != VERSION:
+        sys.exit("unexpected magic/version %#x/%d" % (magic, version))
+    return publish_ns, reclaimed, cpus
+
+
+def percentile(hist, pct):
+    total = sum(hist)
+    if not total:
+        return 0
+    want = -(-total * pct // 100)
+    seen = 0
+    for i, n in enumerate(hist):
+        seen += n
+        if seen >= want:
+            return 2 << i
+    return 2 << (BUCKETS - 1)
+
+
+def report(publish_ns, reclaimed, cpus, prev=None):
+    def field(c_idx, i):
+        return cpus[c_idx][i] - (prev[c_idx][i] if prev else 0)
+
+    totals = [0, 0, 0, 0]
+    executed = [0] * len(BACKENDS)
+    hists = [[0] * BUCKETS for _ in range(NR_HIST)]
+    maxes = [0] * NR_HIST
+    for c_idx, c in enumerate(cpus):
+        for k in range(4):
+            totals[k] += field(c_idx, 2 + k)
+        for be in range(len(BACKENDS)):
+            executed[be] += field(c_idx, BE_EXEC + be)
+        for h in range(NR_HIST):
+            maxes[h] = max(maxes[h], c[LAT_MAX + h])
+            for b in range(BUCKETS):
+                hists[h][b] += field(c_idx, LAT_HIST + h * BUCKETS + b)
+
+    print("publish_ns %d created %d scheduled %d executed %d high %d reclaimed %d"
+          % (publish_ns, totals[0], totals[1], totals[2], totals[3], reclaimed))
+    for be, be_name in enumerate(BACKENDS):
+        print("  %-7s executed %d" % (be_name, executed[be]))
+        for p, name in ((1, "high"), (0, "normal")):
+            h = hists[be * NR_PRIO + p]
+            print("    %-6s count %d p50 <%d p99 <%d max %d"
+                  % (name, sum(h), percentile(h, 50), percentile(h, 99), maxes[be * NR_PRIO + p]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("path", nargs="?", default="/sys/kernel/debug/ex6/stats.bin")
+    parser.add_argument("--interval", type=float, help="poll and print deltas every N seconds")
+    args = parser.parse_args()
+
+    with open(args.path, "rb") as f:
+        buf = mmap.mmap(f.fileno(), 0, prot=mmap.PROT_READ)
+        publish_ns, reclaimed, cpus = snapshot(buf)
+        report(publish_ns, reclaimed, cpus)
+        while args.interval:
+            time.sleep(args.interval)
+            prev = cpus
+            publish_ns, reclaimed, cpus = snapshot(buf)
+            report(publish_ns, reclaimed, cpus, prev)
+
+
+if __name__ == "__main__":
+    main()